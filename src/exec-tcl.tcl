@@ -2,8 +2,6 @@
 #
 # Tcl macros
 #
-set ::udotool::default_delay 0.05
-
 proc ::internal::getopt {_argv opt {hasval 0} {defval "--"}} {
     upvar $_argv argv
     set idx [lsearch $argv $opt]
@@ -19,6 +17,32 @@ proc ::internal::getopt {_argv opt {hasval 0} {defval "--"}} {
     return $val
 }
 
+proc ::internal::motionopts {_argv} {
+    upvar $_argv argv
+    set motion [expr { [::internal::getopt argv -to] != "--" }]
+    set opts {}
+    foreach opt {-duration -rate -curve -via} {
+        set val [::internal::getopt argv $opt 1]
+        if { $val != "--" } {
+            lappend opts $opt $val
+            set motion 1
+        }
+    }
+    if { !$motion } { return "--" }
+    return $opts
+}
+
+proc ::internal::xyz {prefix argv} {
+    set axes {}
+    set vals {}
+    foreach val $argv axis {X Y Z} {
+        if { "$val" == "" } { break }
+        lappend axes "$prefix$axis"
+        lappend vals $val
+    }
+    return [list $axes $vals]
+}
+
 proc keydown {args} {
     eval input {*}[lmap key $args { list [list KEYDOWN $key] SYNC }]
 }
@@ -30,36 +54,54 @@ proc keyup {args} {
 proc wheel {args} {
     set axis REL_WHEEL
     if { [::internal::getopt args -h] != "--" } { set axis REL_HWHEEL }
+    set smooth   [::internal::getopt args -smooth]
+    set duration [::internal::getopt args -duration 1]
     if { [llength $args] != 1 } {
-        error "wrong # of arguments: should be \"wheel ?-h? delta\"" [info stacktrace]
+        error "wrong # of arguments: should be \"wheel ?-h? ?-smooth ?-duration seconds?? delta\"" [info stacktrace]
+    }
+    if { $smooth != "--" } {
+        if { $duration == "--" } { set duration $::udotool::default_smooth_time }
+        ::internal::scroll $axis [lindex $args 0] $duration
+    } elseif { $duration != "--" } {
+        error "option \"-duration\" requires \"-smooth\"" [info stacktrace]
+    } else {
+        input [list $axis $args]
     }
-    input [list $axis $args]
 }
 
 proc move {args} {
     set prefix REL_
     if { [::internal::getopt args -r] != "--" } { set prefix REL_R }
+    set motion [::internal::motionopts args]
     set argn [llength $args]
     if { $argn < 1 || $argn > 3 } {
-        error "wrong # of arguments: should be \"move ?-r? delta_x ?delta_y? ?delta_z?\"" [info stacktrace]
+        error "wrong # of arguments: should be \"move ?-r? ?-to? ?-duration seconds? ?-rate fps? ?-curve curve? ?-via points? delta_x ?delta_y? ?delta_z?\"" [info stacktrace]
+    }
+    lassign [::internal::xyz $prefix $args] axes vals
+    if { $motion != "--" } {
+        ::internal::motion {*}$motion $axes $vals
+    } else {
+        input {*}[lmap axis $axes val $vals { list $axis $val }]
     }
-    input {*}[lmap val $args axis {X Y Z} {
-        if { "$val" == "" } { break }
-        list "$prefix$axis" $val
-    }]
 }
 
 proc position {args} {
     set prefix ABS_
+    set opts {}
     if { [::internal::getopt args -r] != "--" } { set prefix ABS_R }
+    if { [::internal::getopt args -raw] != "--" } { set opts -raw }
+    if { [::internal::getopt args -px]  != "--" } { set opts -raw }
+    set motion [::internal::motionopts args]
     set argn [llength $args]
     if { $argn < 1 || $argn > 3 } {
-        error "wrong # of arguments: should be \"position ?-r? pos_x ?pos_y? ?pos_z?\"" [info stacktrace]
+        error "wrong # of arguments: should be \"position ?-r? ?-raw|-px? ?-to? ?-duration seconds? ?-rate fps? ?-curve curve? ?-via points? pos_x ?pos_y? ?pos_z?\"" [info stacktrace]
+    }
+    lassign [::internal::xyz $prefix $args] axes vals
+    if { $motion != "--" } {
+        ::internal::motion {*}$opts {*}$motion $axes $vals
+    } else {
+        input {*}$opts {*}[lmap axis $axes val $vals { list $axis $val }]
     }
-    input {*}[lmap val $args axis {X Y Z} {
-        if { "$val" == "" } { break }
-        list "$prefix$axis" $val
-    }]
 }
 
 proc key {args} {
@@ -78,17 +120,3 @@ proc key {args} {
         sleep $rep_delay
     }
 }
-
-if { $::udotool::debug > 0 } {
-    set ::internal::system_files {glob.tcl nshelper.tcl oo.tcl stdlib.tcl tclcompat.tcl tree.tcl}
-    set ::internal::system_files [list [info script] {*}$::internal::system_files]
-    xtrace [lambda {mode fname line result cmd arglist} {
-        if { $mode != "cmd" } { return }
-        set level 1
-        if { [lsearch -bool $::internal::system_files $fname] } {
-            if { $::udotool::debug < 3 } { return }
-            set level 3
-        }
-        puts "\[$level\] \[$fname:$line\] $cmd $arglist"
-    }]
-}
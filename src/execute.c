@@ -6,23 +6,46 @@
  */
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 #include <jim.h>
+#include <jim-eventloop.h>
 
 #include "udotool.h"
 #include "execute.h"
 #include "uinput-func.h"
+#include "jimext.h"
+#include "keymap.h"
+#include "motion.h"
+#include "profile.h"
+#include "timing.h"
+#include "track.h"
+#include "tracebin.h"
 
+static Jim_Interp *exec_create(void);
 static Jim_Interp *exec_init(void);
 static int         exec_deinit(Jim_Interp *interp, int err);
 
 static int exec_open     (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
 static int exec_input    (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
 static int exec_timedloop(Jim_Interp *interp, int argc, Jim_Obj *const*argv);
+static int exec_every    (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
 static int exec_names    (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
 static int exec_sleep    (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
+static int exec_track    (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
+static int exec_stats    (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
+static int exec_budget   (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
+static int exec_batch    (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
+static int exec_type     (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
+static int exec_scroll   (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
+static int exec_motion   (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
+static int exec_trace_dump(Jim_Interp *interp, int argc, Jim_Obj *const*argv);
+static int exec_xtrace   (Jim_Interp *interp, int argc, Jim_Obj *const*argv);
 
 /**
  * Extra Tcl commands.
@@ -35,8 +58,18 @@ static const struct exec_cmd {
     { "open",      exec_open,      NULL },
     { "input",     exec_input,     NULL },
     { "timedloop", exec_timedloop, NULL },
+    { "every",     exec_every,     NULL },
     { "names",     exec_names,     NULL },
     { "sleep",     exec_sleep,     "::internal::sleep" },
+    { "track",     exec_track,     NULL },
+    { "stats",     exec_stats,     NULL },
+    { "budget",    exec_budget,    NULL },
+    { "batch",     exec_batch,     NULL },
+    { "type",      exec_type,      NULL },
+    { "trace-dump", exec_trace_dump, NULL },
+    { "::internal::xtrace", exec_xtrace, NULL },
+    { "::internal::scroll", exec_scroll, NULL },
+    { "::internal::motion", exec_motion, NULL },
     { NULL }
 };
 
@@ -48,6 +81,22 @@ static const char PREEXEC_SCRIPT[] = {
     , 0x00
 };
 
+/**
+ * System script files (sorted).
+ *
+ * These are the bootstrap script and Tcl parts of Jim extensions.
+ * Commands executed from these are traced only at verbosity level 3.
+ */
+static const char *const SYSTEM_FILES[] = {
+    "exec-tcl.tcl",
+    "glob.tcl",
+    "nshelper.tcl",
+    "oo.tcl",
+    "stdlib.tcl",
+    "tclcompat.tcl",
+    "tree.tcl",
+};
+
 /**
  * Pseudo-axis name for key down event.
  */
@@ -61,7 +110,39 @@ static const char AXIS_KEYUP[] = "KEYUP";
  */
 static const char AXIS_SYNC[] = "SYNC";
 
+/**
+ * Concurrent track data.
+ */
+struct exec_track {
+    Jim_Interp *interp;  ///< Track interpreter.
+    char       *body;    ///< Track script.
+};
+
+/**
+ * Finish main script.
+ *
+ * This waits for all concurrent tracks to finish, and detaches
+ * main interpreter from the device.
+ *
+ * @param interp  main interpreter.
+ * @param err     error code of the main script.
+ * @return        final error code.
+ */
+static int exec_finish(Jim_Interp *interp, int err) {
+    int ret = track_join();
+    track_set_wait(NULL, NULL);
+    uinput_set_open_callback(NULL, NULL);
+    if (ret < 0 && err != JIM_ERR) {
+        Jim_SetResultFormatted(interp, "one or more tracks failed");
+        return JIM_ERR;
+    }
+    return err;
+}
+
 int exec_args(int argc, const char *const*argv) {
+    int ret;
+    if (exec_fast(argc, argv, &ret))
+        return ret;
     Jim_Interp *interp = exec_init();
     if (interp == NULL)
         return -1;
@@ -70,8 +151,62 @@ int exec_args(int argc, const char *const*argv) {
         return exec_deinit(interp, -1);
     for (int i = 0; i < argc; i++)
         Jim_ListAppendElement(interp, list, Jim_NewStringObj(interp, argv[i], -1));
-    int ret = Jim_EvalObj(interp, list);
-    return exec_deinit(interp, ret);
+    ret = Jim_EvalObj(interp, list);
+    return exec_deinit(interp, exec_finish(interp, ret));
+}
+
+/**
+ * Execute commands from standard input.
+ *
+ * Each command is executed as soon as it's complete, without waiting
+ * for end of input. While a command is incomplete because of an open
+ * brace, bracket, or quote, completeness is checked again only after
+ * a line with the matching closing character, so long multi-line
+ * commands are not reparsed on every line.
+ *
+ * @param interp  interpreter.
+ * @return        error code.
+ */
+static int exec_stdin(Jim_Interp *interp) {
+    char *line = NULL;
+    size_t line_size = 0;
+    int lineno = 0, start = 1, ret = JIM_OK;
+    char state = ' ';
+    ssize_t len;
+    Jim_Obj *script = NULL;
+    while ((len = getline(&line, &line_size, stdin)) >= 0) {
+        if (script == NULL) {
+            start = lineno + 1;
+            script = Jim_NewEmptyStringObj(interp);
+            Jim_IncrRefCount(script);
+        }
+        ++lineno;
+        Jim_AppendString(interp, script, line, (int)len);
+
+        const char *closing = state == '{' ? "}" : state == '[' ? "]" : state == '"' ? "\"" : NULL;
+        if (closing != NULL && strpbrk(line, closing) == NULL)
+            continue;
+        if (!Jim_ScriptIsComplete(interp, script, &state))
+            continue;
+        state = ' ';
+        ret = Jim_EvalSource(interp, "stdin", start, Jim_String(script));
+        Jim_DecrRefCount(interp, script);
+        script = NULL;
+        if (ret != JIM_OK)
+            break;
+    }
+    if (ret == JIM_OK && ferror(stdin)) {
+        Jim_SetResultFormatted(interp, "error reading standard input: %s", strerror(errno));
+        ret = JIM_ERR;
+    }
+    if (script != NULL) {
+        // Incomplete command at the end of input; let the parser report it
+        if (ret == JIM_OK)
+            ret = Jim_EvalSource(interp, "stdin", start, Jim_String(script));
+        Jim_DecrRefCount(interp, script);
+    }
+    free(line);
+    return ret;
 }
 
 int exec_file(const char *filename) {
@@ -80,10 +215,10 @@ int exec_file(const char *filename) {
         return -1;
     int ret;
     if (filename == NULL)
-        ret = Jim_Eval(interp, "eval [info source [stdin read] stdin 1]");
+        ret = exec_stdin(interp);
     else
         ret = Jim_EvalFile(interp, filename);
-    return exec_deinit(interp, ret);
+    return exec_deinit(interp, exec_finish(interp, ret));
 }
 
 /**
@@ -103,7 +238,13 @@ static int set_opt_var(Jim_Interp *interp, const char *name, int opt) {
     return Jim_SetVariableStrWithStr(interp, name, buffer);
 }
 
-static int set_verbosity_var(Jim_Interp *interp) {
+/**
+ * Set Tcl variables from global configuration.
+ *
+ * @param interp  interpreter.
+ * @return        error code.
+ */
+static int set_config_vars(Jim_Interp *interp) {
     char buffer[32];
     int ret;
     snprintf(buffer, sizeof(buffer), "%d", CFG_VERBOSITY);
@@ -112,6 +253,18 @@ static int set_verbosity_var(Jim_Interp *interp) {
     snprintf(buffer, sizeof(buffer), "%d", CFG_DRY_RUN);
     if ((ret = Jim_SetVariableStrWithStr(interp, "::udotool::dry_run", buffer)) != JIM_OK)
         return ret;
+    snprintf(buffer, sizeof(buffer), "%g", CFG_TIME_SCALE);
+    if ((ret = Jim_SetVariableStrWithStr(interp, "::udotool::time_scale", buffer)) != JIM_OK)
+        return ret;
+    snprintf(buffer, sizeof(buffer), "%g", DEFAULT_KEY_DELAY);
+    if ((ret = Jim_SetVariableStrWithStr(interp, "::udotool::default_delay", buffer)) != JIM_OK)
+        return ret;
+    snprintf(buffer, sizeof(buffer), "%g", DEFAULT_SMOOTH_TIME);
+    if ((ret = Jim_SetVariableStrWithStr(interp, "::udotool::default_smooth_time", buffer)) != JIM_OK)
+        return ret;
+    const char *keymap = getenv("UDOTOOL_KEYMAP");
+    if (keymap != NULL && (ret = Jim_SetVariableStrWithStr(interp, "::udotool::keymap", keymap)) != JIM_OK)
+        return ret;
     return JIM_OK;
 }
 
@@ -127,20 +280,87 @@ static void open_callback(const char *sysname, void *data) {
 }
 
 /**
- * Initialize Tcl interpreter.
+ * Event loop timer callback.
+ *
+ * @param interp  interpreter.
+ * @param data    pointer to flag to set.
+ */
+static void exec_wake(Jim_Interp *interp, void *data) {
+    (void)interp;
+    *(int *)data = 1;
+}
+
+/**
+ * Wait for a deadline, processing Jim events meanwhile.
+ *
+ * If the interpreter has no event loop, or in virtual time mode,
+ * this is a plain sleep.
+ *
+ * @param deadline  monotonic time to wait until, in seconds.
+ * @param data      interpreter.
+ * @return          zero if deadline was reached, positive value if
+ *                  returned early, or `-1` on error.
+ */
+static int exec_wait_events(double deadline, void *data) {
+    Jim_Interp *interp = data;
+    if (CFG_VIRTUAL_TIME || Jim_GetAssocData(interp, "eventloop") == NULL)
+        return timing_sleep_until(deadline);
+    double delay = deadline - timing_now();
+    if (delay <= 0) {
+        Jim_ProcessEvents(interp, JIM_ALL_EVENTS|JIM_DONT_WAIT);
+        return 0;
+    }
+    int fired = 0;
+    jim_wide id = Jim_CreateTimeHandler(interp, (jim_wide)(delay*CFG_TIME_SCALE*USEC_PER_SEC) + 1,
+                                        exec_wake, &fired, NULL);
+    Jim_ProcessEvents(interp, JIM_ALL_EVENTS);
+    if (!fired)
+        Jim_DeleteTimeHandler(interp, id);
+    return timing_now() < deadline ? 1 : 0;
+}
+
+/**
+ * Original Jim allocator, or `NULL` if not replaced yet.
+ */
+static void *(*JIM_ALLOCATOR)(void *ptr, size_t size) = NULL;
+
+/**
+ * Counting Jim allocator.
+ *
+ * @param ptr   memory block to reallocate or free, or `NULL`.
+ * @param size  new block size, or zero to free.
+ * @return      allocated block.
+ */
+static void *exec_allocator(void *ptr, size_t size) {
+    if (size > 0)
+        UINPUT_STATS.allocations++;
+    return (*JIM_ALLOCATOR)(ptr, size);
+}
+
+/**
+ * Create and set up a Tcl interpreter.
  *
  * @return new Tcl interpreter.
  */
-static Jim_Interp *exec_init() {
+static Jim_Interp *exec_create() {
+    if (JIM_ALLOCATOR == NULL) {
+        JIM_ALLOCATOR = Jim_Allocator;
+        Jim_Allocator = exec_allocator;
+    }
+    double start = timing_real_now();
     Jim_Interp *interp = Jim_CreateInterp();
     if (interp == NULL)
         return NULL;
     Jim_RegisterCoreCommands(interp);
+    timing_phase(TIMING_PHASE_INTERP, start, 1);
     int ret;
-    if ((ret = Jim_InitStaticExtensions(interp)) != JIM_OK) {
+    start = timing_real_now();
+    if ((ret = jimext_init(interp)) != JIM_OK) {
         exec_deinit(interp, ret);
         return NULL;
     }
+    timing_phase(TIMING_PHASE_EXTENSIONS, start, 1);
+    start = timing_real_now();
     for (const struct exec_cmd *cmd = COMMANDS; cmd->name != NULL; cmd++) {
         if (cmd->old_name != NULL) {
             Jim_Obj *name = Jim_NewStringObj(interp, cmd->name, -1);
@@ -159,15 +379,36 @@ static Jim_Interp *exec_init() {
         (ret = set_opt_var(interp, "::udotool::dev_name",    UINPUT_OPT_DEVNAME)) != JIM_OK ||
         (ret = set_opt_var(interp, "::udotool::dev_id",      UINPUT_OPT_DEVID)) != JIM_OK ||
         (ret = set_opt_var(interp, "::udotool::settle_time", UINPUT_OPT_SETTLE)) != JIM_OK ||
-        (ret = set_verbosity_var(interp)) != JIM_OK) {
+        (ret = set_config_vars(interp)) != JIM_OK) {
         exec_deinit(interp, ret);
         return NULL;
     }
-    uinput_set_open_callback(open_callback, interp);
+    timing_phase(TIMING_PHASE_INTERP, start, 0);
+    start = timing_real_now();
     if ((ret = Jim_EvalSource(interp, "exec-tcl.tcl", 1, PREEXEC_SCRIPT)) != JIM_OK) {
         exec_deinit(interp, ret);
         return NULL;
     }
+    timing_phase(TIMING_PHASE_BOOTSTRAP, start, 1);
+    if ((CFG_VERBOSITY > 0 || CFG_PROFILE > 0 || tracebin_active()) &&
+        (ret = Jim_Eval(interp, "xtrace ::internal::xtrace")) != JIM_OK) {
+        exec_deinit(interp, ret);
+        return NULL;
+    }
+    return interp;
+}
+
+/**
+ * Initialize main Tcl interpreter.
+ *
+ * @return new Tcl interpreter.
+ */
+static Jim_Interp *exec_init() {
+    Jim_Interp *interp = exec_create();
+    if (interp != NULL) {
+        uinput_set_open_callback(open_callback, interp);
+        track_set_wait(exec_wait_events, interp);
+    }
     return interp;
 }
 
@@ -214,7 +455,6 @@ static void print_object(Jim_Interp *interp, Jim_Obj *obj) {
  * @return        exit code.
  */
 static int exec_deinit(Jim_Interp *interp, int err) {
-    uinput_set_open_callback(NULL, NULL);
     int ret = -1;
     if (err == JIM_ERR)
         Jim_MakeErrorMessage(interp);
@@ -229,64 +469,127 @@ static int exec_deinit(Jim_Interp *interp, int err) {
 }
 
 /**
- * Parse an absolute axis value.
+ * Parse a plain decimal integer in place.
  *
- * Values for absolute axes are specified in percent of the maximum value.
+ * @param str   string to parse.
+ * @param pval  pointer to buffer for parsed value.
+ * @return      zero on success, or `-1` if not a plain integer in range.
+ */
+static int parse_int(const char *str, long *pval) {
+    const char *sp = str;
+    int neg = 0;
+    if (*sp == '-' || *sp == '+')
+        neg = *sp++ == '-';
+    if (*sp == '\0')
+        return -1;
+    long value = 0;
+    for (; *sp != '\0'; sp++) {
+        if (*sp < '0' || *sp > '9' || value > (INT_MAX - (*sp - '0'))/10)
+            return -1;
+        value = value*10 + (*sp - '0');
+    }
+    *pval = neg ? -value : value;
+    return 0;
+}
+
+/**
+ * Parse a numeric value.
+ *
+ * Value is either an object, or (if `obj` is `NULL`) a string. Strings
+ * are parsed in place, without creating objects, and plain integers
+ * skip floating-point parsing.
  *
  * @param interp  interpreter.
- * @param obj     object to parse.
+ * @param obj     object to parse, or `NULL`.
+ * @param str     string to parse, if `obj` is `NULL`.
  * @param pval    pointer to buffer for parsed value.
+ * @param pint    pointer to buffer for integer flag: set to non-zero
+ *                if the value is an integer within `int` range.
  * @return        error code.
  */
-static int parse_abs_value(Jim_Interp *interp, Jim_Obj *obj, double *pval) {
-    double value = 0;
-    int ret = Jim_GetDouble(interp, obj, &value);
-    if (ret != JIM_OK)
-        return ret;
-    value /= 100.0;
-    if (value < 0 || value > 1.0) {
-        Jim_SetResultFormatted(interp, "value is out of range in \"%#s\"", obj);
-        return JIM_ERR;
+static int parse_value(Jim_Interp *interp, Jim_Obj *obj, const char *str, double *pval, int *pint) {
+    if (obj == NULL) {
+        long ival;
+        if (parse_int(str, &ival) == 0) {
+            *pval = ival;
+            *pint = 1;
+            return JIM_OK;
+        }
+        char *ep = NULL;
+        *pval = strtod(str, &ep);
+        if (ep == str || *ep != '\0') {
+            Jim_SetResultFormatted(interp, "expected floating-point number but got \"%s\"", str);
+            return JIM_ERR;
+        }
+    } else {
+        int ret = Jim_GetDouble(interp, obj, pval);
+        if (ret != JIM_OK)
+            return ret;
     }
-    *pval = value;
+    *pint = *pval >= INT_MIN && *pval <= INT_MAX && *pval == (int)*pval;
     return JIM_OK;
 }
 
 /**
- * Parse a relative axis value.
+ * Parse an absolute axis value.
  *
- * Values for relative axes are usually integer, except for the wheel axes.
+ * Values for absolute axes are specified in percent of the axis range,
+ * or in device units (if `raw` is set). Integer percents are converted
+ * exactly.
  *
  * @param interp  interpreter.
- * @param obj     object to parse.
- * @param pval    pointer to buffer for parsed value.
+ * @param obj     object to parse, or `NULL`.
+ * @param str     string to parse, if `obj` is `NULL`.
+ * @param arg     argument (for error messages).
+ * @param axis    axis code.
+ * @param raw     if not zero, value is in device units.
+ * @param pval    pointer to buffer for parsed value, in device units.
  * @return        error code.
  */
-static int parse_rel_value(Jim_Interp *interp, Jim_Obj *obj, double *pval) {
+static int parse_abs_value(Jim_Interp *interp, Jim_Obj *obj, const char *str, Jim_Obj *arg,
+                           int axis, int raw, int *pval) {
     double value = 0;
-    int ret = Jim_GetDouble(interp, obj, &value);
+    int is_int = 0, min = 0, max = 100;
+    int ret = parse_value(interp, obj, str, &value, &is_int);
     if (ret != JIM_OK)
         return ret;
-    if (value < INT_MIN || value > INT_MAX) {
-        Jim_SetResultFormatted(interp, "value is out of range in \"%#s\"", obj);
+    if (raw && !is_int) {
+        Jim_SetResultFormatted(interp, "expected integer value in \"%#s\"", arg);
         return JIM_ERR;
     }
-    *pval = value;
+    if (raw)
+        uinput_abs_range(axis, &min, &max);
+    if (value < min || value > max) {
+        Jim_SetResultFormatted(interp, "value is out of range in \"%#s\"", arg);
+        return JIM_ERR;
+    }
+    *pval = raw ? (int)value : uinput_abs_scale(axis, value);
     return JIM_OK;
 }
 
 /**
- * Get time.
+ * Parse a relative axis value.
+ *
+ * Values for relative axes are usually integer, except for the wheel axes.
  *
  * @param interp  interpreter.
- * @param tv      pointer to buffer for time value.
+ * @param obj     object to parse, or `NULL`.
+ * @param str     string to parse, if `obj` is `NULL`.
+ * @param arg     argument (for error messages).
+ * @param pval    pointer to buffer for parsed value.
  * @return        error code.
  */
-static int get_time(Jim_Interp *interp, struct timeval *tv) {
-    if (gettimeofday(tv, NULL) < 0) {
-        Jim_SetResultFormatted(interp, "cannot get current time: %s", strerror(errno));
+static int parse_rel_value(Jim_Interp *interp, Jim_Obj *obj, const char *str, Jim_Obj *arg, double *pval) {
+    double value = 0;
+    int is_int = 0;
+    int ret = parse_value(interp, obj, str, &value, &is_int);
+    if (ret != JIM_OK)
+        return ret;
+    if (value < INT_MIN || value > INT_MAX) {
+        Jim_SetResultFormatted(interp, "value is out of range in \"%#s\"", arg);
         return JIM_ERR;
     }
+    *pval = value;
     return JIM_OK;
 }
 
@@ -305,101 +608,121 @@ static int exec_open(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
     return JIM_OK;
 }
 
+/**
+ * Check whether a string can be used in place as a single-element list.
+ *
+ * @param str  string to check.
+ * @return     non-zero if string contains no list syntax characters.
+ */
+static int is_plain_word(const char *str) {
+    return *str != '\0' && str[strcspn(str, " \t\n\r\f\v{}\"\\")] == '\0';
+}
+
 /**
  * Tcl command: input
+ *
+ * Arguments that are already lists, and plain `axis=value` words, are
+ * parsed in place, so that steady-state emission doesn't allocate.
  */
 static int exec_input(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
     const char *cmd = Jim_String(argv[0]);
-    for (int n = 1; n < argc; n++) {
-        int llen = Jim_ListLength(interp, argv[n]);
-        if (llen == 0 || llen > 2) {
-            Jim_SetResultFormatted(interp, "incorrect list length in \"%#s\"", argv[n]);
-            return JIM_ERR;
-        }
-        int do_split = 0;
-        Jim_Obj *axis = NULL, *value = NULL;
-        if (llen == 1) {
+    char axis_buf[MAX_OBJECT_NAME];
+    int first = 1, raw = 0;
+    if (argc > 1 && !Jim_IsList(argv[1]) && strcmp(Jim_String(argv[1]), "-raw") == 0) {
+        raw = 1;
+        first++;
+    }
+    for (int n = first; n < argc; n++) {
+        const char *axis_str = NULL, *value_str = NULL;
+        Jim_Obj *value = NULL;
+        if (!Jim_IsList(argv[n]) && is_plain_word(Jim_String(argv[n]))) {
             const char *arg = Jim_String(argv[n]);
             const char *sep = strchr(arg, '=');
-            if (sep == NULL) {
-                axis = argv[n];
-                value = NULL;
-            } else {
-                do_split = 1;
-                axis = Jim_NewStringObj(interp, arg, sep - arg);
-                value = Jim_NewStringObj(interp, sep + 1, -1);
+            if (sep == NULL)
+                axis_str = arg;
+            else {
+                size_t len = sep - arg;
+                if (len >= sizeof(axis_buf)) {
+                    // Too long for any known axis; don't truncate it into one
+                    Jim_SetResultFormatted(interp, "unknown axis name in \"%#s\"", argv[n]);
+                    return JIM_ERR;
+                }
+                memcpy(axis_buf, arg, len);
+                axis_buf[len] = '\0';
+                axis_str  = axis_buf;
+                value_str = sep + 1;
             }
         } else {
-            axis = Jim_ListGetIndex(interp, argv[n], 0);
-            value = Jim_ListGetIndex(interp, argv[n], 1);
+            int llen = Jim_ListLength(interp, argv[n]);
+            if (llen == 0 || llen > 2) {
+                Jim_SetResultFormatted(interp, "incorrect list length in \"%#s\"", argv[n]);
+                return JIM_ERR;
+            }
+            axis_str = Jim_String(Jim_ListGetIndex(interp, argv[n], 0));
+            if (llen == 2)
+                value = Jim_ListGetIndex(interp, argv[n], 1);
+            else {
+                const char *sep = strchr(axis_str, '=');
+                if (sep != NULL) {
+                    size_t len = sep - axis_str;
+                    if (len >= sizeof(axis_buf)) {
+                        Jim_SetResultFormatted(interp, "unknown axis name in \"%#s\"", argv[n]);
+                        return JIM_ERR;
+                    }
+                    memcpy(axis_buf, axis_str, len);
+                    axis_buf[len] = '\0';
+                    axis_str  = axis_buf;
+                    value_str = sep + 1;
+                }
+            }
         }
 
-        const char *axis_str = Jim_String(axis);
         if (strcasecmp(AXIS_SYNC, axis_str) == 0) {
             if (uinput_sync() < 0) {
                 Jim_SetResultFormatted(interp, "device sync error");
-                goto ON_ERROR;
+                return JIM_ERR;
             }
-            goto ON_CONTINUE;
+            continue;
         }
-        if (value == NULL) {
+        if (value == NULL && value_str == NULL) {
             Jim_SetResultFormatted(interp, "missing separator in \"%#s\"", argv[n]);
-            goto ON_ERROR;
-        }
-        if (strcasecmp(AXIS_KEYDOWN, axis_str) == 0) {
-            int key;
-            if ((key = uinput_find_key(cmd, Jim_String(value))) < 0) {
-                Jim_SetResultFormatted(interp, "unknown key name in \"%#s\"", argv[n]);
-                goto ON_ERROR;
-            }
-            if (uinput_keyop(key, 1, 0) < 0) {
-                Jim_SetResultFormatted(interp, "device event error");
-                goto ON_ERROR;
-            }
-            goto ON_CONTINUE;
+            return JIM_ERR;
         }
-        if (strcasecmp(AXIS_KEYUP, axis_str) == 0) {
+        int keydown = strcasecmp(AXIS_KEYDOWN, axis_str) == 0;
+        if (keydown || strcasecmp(AXIS_KEYUP, axis_str) == 0) {
             int key;
-            if ((key = uinput_find_key(cmd, Jim_String(value))) < 0) {
+            if ((key = uinput_find_key(cmd, value != NULL ? Jim_String(value) : value_str)) < 0) {
                 Jim_SetResultFormatted(interp, "unknown key name in \"%#s\"", argv[n]);
-                goto ON_ERROR;
+                return JIM_ERR;
             }
-            if (uinput_keyop(key, 0, 0) < 0) {
+            if (uinput_keyop(key, keydown, 0) < 0) {
                 Jim_SetResultFormatted(interp, "device event error");
-                goto ON_ERROR;
+                return JIM_ERR;
             }
-            goto ON_CONTINUE;
+            continue;
         }
         int axis_code, abs_flag = 0;
         if ((axis_code = uinput_find_axis(cmd, axis_str, UDOTOOL_AXIS_BOTH, &abs_flag)) < 0) {
-ON_ERROR:
-            if (do_split) {
-                Jim_FreeObj(interp, axis);
-                Jim_FreeObj(interp, value);
-            }
+            Jim_SetResultFormatted(interp, "unknown axis name in \"%#s\"", argv[n]);
             return JIM_ERR;
         }
-        double dval = 0;
         if (abs_flag) {
-            if (parse_abs_value(interp, value, &dval) < 0)
-                goto ON_ERROR;
-            if (uinput_absop(axis_code, dval, 0) < 0) {
+            int ival = 0;
+            if (parse_abs_value(interp, value, value_str, argv[n], axis_code, raw, &ival) != JIM_OK)
+                return JIM_ERR;
+            if (uinput_absop_raw(axis_code, ival, 0) < 0) {
                 Jim_SetResultFormatted(interp, "device event error");
-                goto ON_ERROR;
+                return JIM_ERR;
             }
         } else {
-            if (parse_rel_value(interp, value, &dval) < 0)
-                goto ON_ERROR;
+            double dval = 0;
+            if (parse_rel_value(interp, value, value_str, argv[n], &dval) != JIM_OK)
+                return JIM_ERR;
             if (uinput_relop(axis_code, dval, 0) < 0) {
                 Jim_SetResultFormatted(interp, "device event error");
-                goto ON_ERROR;
+                return JIM_ERR;
             }
         }
-ON_CONTINUE:
-        if (do_split) {
-            Jim_FreeObj(interp, axis);
-            Jim_FreeObj(interp, value);
-        }
     }
     if (uinput_sync() < 0) {
         Jim_SetResultFormatted(interp, "device sync error");
@@ -408,72 +731,122 @@ ON_CONTINUE:
     return JIM_OK;
 }
 
+/**
+ * Add a field to a statistics dictionary.
+ *
+ * @param interp  interpreter.
+ * @param dict    dictionary object.
+ * @param name    field name.
+ * @param value   field value.
+ */
+static void add_stat(Jim_Interp *interp, Jim_Obj *dict, const char *name, Jim_Obj *value) {
+    Jim_DictAddElement(interp, dict, Jim_NewStringObj(interp, name, -1), value);
+}
+
 /**
  * Tcl command: timedloop
  */
 static int exec_timedloop(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
-    if (argc < 3 || argc > 6) {
-        Jim_WrongNumArgs(interp, 1, argv, "time ?num? ?varTime? ?varNum? body");
+    static const char *const options[] = { "-interval", "-stats", NULL };
+    int ret, first = 1, opt = 0;
+
+    double interval = 0;
+    Jim_Obj *var_stats = NULL;
+    for (; first + 1 < argc &&
+           Jim_GetEnum(interp, argv[first], options, &opt, NULL, JIM_NONE) == JIM_OK; first += 2) {
+        switch (opt) {
+        case 0: // -interval
+            if ((ret = Jim_GetDouble(interp, argv[first + 1], &interval)) != JIM_OK)
+                return ret;
+            if (interval < MIN_SLEEP_SEC || interval > MAX_SLEEP_SEC) {
+                Jim_SetResultFormatted(interp, "interval out of range: %#s", argv[first + 1]);
+                return JIM_ERR;
+            }
+            break;
+        case 1: // -stats
+            var_stats = argv[first + 1];
+            if (Jim_Length(var_stats) == 0)
+                var_stats = NULL;
+            break;
+        }
+    }
+    Jim_Obj *const*args = &argv[first];
+    int nargs = argc - first;
+    if (nargs < 2 || nargs > 5) {
+        Jim_WrongNumArgs(interp, 1, argv,
+            "?-interval seconds? ?-stats varName? time ?num? ?varTime? ?varNum? body");
         return JIM_ERR;
     }
-    int ret;
 
     double rep_time = 0;
     jim_wide rep_num = -1;
     Jim_Obj *var_time = NULL;
     Jim_Obj *var_num = NULL;
-    Jim_Obj *body = argv[argc - 1];
-    --argc;
-    if ((ret = Jim_GetDouble(interp, argv[1], &rep_time)) != JIM_OK)
+    Jim_Obj *body = args[nargs - 1];
+    --nargs;
+    if ((ret = Jim_GetDouble(interp, args[0], &rep_time)) != JIM_OK)
         return ret;
     if (rep_time < 0 || rep_time > MAX_SLEEP_SEC) {
-        Jim_SetResultFormatted(interp, "loop time out of range: %#s", argv[1]);
+        Jim_SetResultFormatted(interp, "loop time out of range: %#s", args[0]);
         return JIM_ERR;
     }
-    if (argc > 2 && (ret = Jim_GetWideExpr(interp, argv[2], &rep_num)) != JIM_OK)
+    if (nargs > 1 && (ret = Jim_GetWideExpr(interp, args[1], &rep_num)) != JIM_OK)
         return ret;
-    if (argc > 3) {
-        var_time = argv[3];
+    if (nargs > 2) {
+        var_time = args[2];
         if (Jim_Length(var_time) == 0)
             var_time = NULL;
     }
-    if (argc > 4) {
-        var_num = argv[4];
+    if (nargs > 3) {
+        var_num = args[3];
         if (Jim_Length(var_num) == 0)
             var_num = NULL;
     }
 
-    struct timeval start_ts, end_ts;
-    if ((ret = get_time(interp, &start_ts)) != JIM_OK)
-        return ret;
-    timerclear(&end_ts);
-    if (rep_time != 0) {
-        end_ts.tv_sec = (time_t)rep_time;
-        end_ts.tv_usec = (suseconds_t)(USEC_PER_SEC * (rep_time - end_ts.tv_sec));
-        timeradd(&start_ts, &end_ts, &end_ts);
-    }
+    double start_ts = timing_now();
+    double end_ts = rep_time != 0 ? start_ts + rep_time : 0;
+    double max_late = 0, total_cost = 0;
+    jim_wide late_num = 0, iter_num = 0;
     for (jim_wide rep = 0; rep_num < 0 || rep < rep_num; rep++) {
-        double iter_time = 0;
+        double iter_ts = start_ts;
         if (rep > 0) {
-            struct timeval curr_ts;
-            if ((ret = get_time(interp, &curr_ts)) != JIM_OK)
-                return ret;
-            if (timerisset(&end_ts) && !timercmp(&curr_ts, &end_ts, <))
+            if (interval != 0) {
+                double sched_ts = start_ts + rep*interval;
+                if (end_ts != 0 && sched_ts >= end_ts)
+                    break;
+                if (track_wait_until(sched_ts) < 0) {
+                    Jim_SetResultFormatted(interp, "error when sleeping: %s", strerror(errno));
+                    ret = JIM_ERR;
+                    break;
+                }
+                iter_ts = timing_now();
+                double late = iter_ts - sched_ts;
+                if (late > max_late)
+                    max_late = late;
+                if (late > MIN_SLEEP_SEC)
+                    ++late_num;
+            } else
+                iter_ts = timing_now();
+            if (end_ts != 0 && iter_ts >= end_ts)
                 break;
-            timersub(&curr_ts, &start_ts, &curr_ts);
-            iter_time = curr_ts.tv_sec + ((double)curr_ts.tv_usec)/USEC_PER_SEC;
         }
         if (var_time != NULL) {
-            Jim_Obj *expr_time = Jim_NewDoubleObj(interp, iter_time);
+            Jim_Obj *expr_time = Jim_NewDoubleObj(interp, iter_ts - start_ts);
             if ((ret = Jim_SetVariable(interp, var_time, expr_time)) != JIM_OK)
-                return ret;
+                break;
         }
         if (var_num != NULL) {
             Jim_Obj *expr_num = Jim_NewIntObj(interp, rep);
             if ((ret = Jim_SetVariable(interp, var_num, expr_num)) != JIM_OK)
-                return ret;
+                break;
         }
         ret = Jim_EvalObj(interp, body);
+        total_cost += timing_now() - iter_ts;
+        ++iter_num;
+        if (ret == JIM_BREAK) {
+            ret = JIM_OK;
+            break;
+        }
         if (ret != JIM_OK && ret != JIM_CONTINUE)
             break;
         ret = JIM_OK;
@@ -482,6 +855,161 @@ static int exec_timedloop(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
         Jim_UnsetVariable(interp, var_time, 0);
     if (var_num != NULL)
         Jim_UnsetVariable(interp, var_num, 0);
+    if (var_stats != NULL) {
+        Jim_Obj *stats = Jim_NewDictObj(interp, NULL, 0);
+        add_stat(interp, stats, "iterations",   Jim_NewIntObj(interp, iter_num));
+        add_stat(interp, stats, "late",         Jim_NewIntObj(interp, late_num));
+        add_stat(interp, stats, "max_lateness", Jim_NewDoubleObj(interp, max_late));
+        add_stat(interp, stats, "mean_cost",    Jim_NewDoubleObj(interp, iter_num > 0 ? total_cost/iter_num : 0));
+        int sret = Jim_SetVariable(interp, var_stats, stats);
+        if (ret == JIM_OK)
+            ret = sret;
+    }
+    return ret;
+}
+
+/**
+ * Periodic timer state.
+ */
+struct every_timer {
+    int      fd;        ///< Timer handle, or `-1` for virtual time.
+    double   start;     ///< Start time.
+    double   interval;  ///< Timer interval.
+    uint64_t tick;      ///< Number of last expired tick (virtual time only).
+};
+
+/**
+ * Wait for a periodic timer to expire.
+ *
+ * @param interp  interpreter.
+ * @param timer   timer state.
+ * @param pticks  pointer to buffer for number of expirations.
+ * @return        error code.
+ */
+static int every_wait(Jim_Interp *interp, struct every_timer *timer, uint64_t *pticks) {
+    if (timer->fd < 0) {
+        if (track_wait_until(timer->start + (timer->tick + 1)*timer->interval) < 0) {
+            Jim_SetResultFormatted(interp, "error when sleeping: %s", strerror(errno));
+            return JIM_ERR;
+        }
+        // Small bias compensates for rounding when we're exactly at tick time
+        uint64_t tick = (uint64_t)((timing_now() - timer->start)/timer->interval + 1e-9);
+        if (tick <= timer->tick)
+            tick = timer->tick + 1;
+        *pticks = tick - timer->tick;
+        timer->tick = tick;
+        return JIM_OK;
+    }
+    int fd = timer->fd;
+    for (;;) {
+        ssize_t len = read(fd, pticks, sizeof(*pticks));
+        if (len == sizeof(*pticks))
+            return JIM_OK;
+        if (len < 0 && errno != EAGAIN && errno != EINTR) {
+            Jim_SetResultFormatted(interp, "timer read error: %s", strerror(errno));
+            return JIM_ERR;
+        }
+        struct itimerspec its;
+        if (timerfd_gettime(fd, &its) < 0) {
+            Jim_SetResultFormatted(interp, "timer read error: %s", strerror(errno));
+            return JIM_ERR;
+        }
+        double delay = (its.it_value.tv_sec + its.it_value.tv_nsec/NSEC_PER_SEC)/CFG_TIME_SCALE;
+        if (track_wait_until(timing_now() + delay) < 0) {
+            Jim_SetResultFormatted(interp, "error when sleeping: %s", strerror(errno));
+            return JIM_ERR;
+        }
+    }
+}
+
+/**
+ * Tcl command: every
+ */
+static int exec_every(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    static const char *const options[] = { "-count", "-time", "-overrun", NULL };
+    if (argc < 3 || argc % 2 == 0) {
+        Jim_WrongNumArgs(interp, 1, argv, "interval ?-count num? ?-time seconds? ?-overrun varName? body");
+        return JIM_ERR;
+    }
+    int ret;
+
+    double interval = 0, rep_time = 0;
+    jim_wide rep_num = -1;
+    Jim_Obj *var_overrun = NULL;
+    Jim_Obj *body = argv[argc - 1];
+    if ((ret = Jim_GetDouble(interp, argv[1], &interval)) != JIM_OK)
+        return ret;
+    if (interval < MIN_SLEEP_SEC || interval > MAX_SLEEP_SEC) {
+        Jim_SetResultFormatted(interp, "interval out of range: %#s", argv[1]);
+        return JIM_ERR;
+    }
+    for (int n = 2; n < argc - 1; n += 2) {
+        int opt = 0;
+        if ((ret = Jim_GetEnum(interp, argv[n], options, &opt, "option", JIM_ERRMSG)) != JIM_OK)
+            return ret;
+        switch (opt) {
+        case 0: // -count
+            if ((ret = Jim_GetWideExpr(interp, argv[n + 1], &rep_num)) != JIM_OK)
+                return ret;
+            break;
+        case 1: // -time
+            if ((ret = Jim_GetDouble(interp, argv[n + 1], &rep_time)) != JIM_OK)
+                return ret;
+            if (rep_time < 0 || rep_time > MAX_SLEEP_SEC) {
+                Jim_SetResultFormatted(interp, "loop time out of range: %#s", argv[n + 1]);
+                return JIM_ERR;
+            }
+            break;
+        case 2: // -overrun
+            var_overrun = argv[n + 1];
+            if (Jim_Length(var_overrun) == 0)
+                var_overrun = NULL;
+            break;
+        }
+    }
+
+    struct every_timer timer = { .fd = -1, .interval = interval, .tick = 0 };
+    if (!CFG_VIRTUAL_TIME) {
+        if ((timer.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK)) < 0) {
+            Jim_SetResultFormatted(interp, "cannot create timer: %s", strerror(errno));
+            return JIM_ERR;
+        }
+        struct itimerspec its;
+        timing_to_timespec(interval*CFG_TIME_SCALE, &its.it_interval);
+        its.it_value = its.it_interval;
+        if (timerfd_settime(timer.fd, 0, &its, NULL) < 0) {
+            Jim_SetResultFormatted(interp, "cannot start timer: %s", strerror(errno));
+            close(timer.fd);
+            return JIM_ERR;
+        }
+    }
+    timer.start = timing_now();
+    uint64_t ticks = 1;
+    for (jim_wide rep = 0; rep_num < 0 || rep < rep_num; rep++) {
+        if (rep > 0) {
+            if ((ret = every_wait(interp, &timer, &ticks)) != JIM_OK)
+                break;
+            if (rep_time != 0 && timing_now() - timer.start >= rep_time)
+                break;
+        }
+        if (var_overrun != NULL) {
+            Jim_Obj *expr_overrun = Jim_NewIntObj(interp, (jim_wide)(ticks - 1));
+            if ((ret = Jim_SetVariable(interp, var_overrun, expr_overrun)) != JIM_OK)
+                break;
+        }
+        ret = Jim_EvalObj(interp, body);
+        if (ret == JIM_BREAK) {
+            ret = JIM_OK;
+            break;
+        }
+        if (ret != JIM_OK && ret != JIM_CONTINUE)
+            break;
+        ret = JIM_OK;
+    }
+    if (timer.fd >= 0)
+        close(timer.fd);
+    if (var_overrun != NULL)
+        Jim_UnsetVariable(interp, var_overrun, 0);
     return ret;
 }
 
@@ -540,15 +1068,512 @@ static int exec_sleep(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
     int ret;
     if ((ret = Jim_GetDouble(interp, argv[1], &delay)) != JIM_OK)
         return ret;
-    struct timespec tval;
-    memset(&tval, 0, sizeof(tval));
-    tval.tv_sec = (time_t)delay;
-    tval.tv_nsec = (long)((delay - tval.tv_sec)*NSEC_PER_SEC);
-    while (nanosleep(&tval, &tval) != 0) {
-        if (errno != EINTR) {
+    if (delay < 0 || delay > MAX_SLEEP_SEC) {
+        Jim_SetResultFormatted(interp, "sleep time out of range: %#s", argv[1]);
+        return JIM_ERR;
+    }
+    if (track_wait_until(timing_now() + delay) < 0) {
+        Jim_SetResultFormatted(interp, "error when sleeping: %s", strerror(errno));
+        return JIM_ERR;
+    }
+    Jim_SetEmptyResult(interp);
+    return JIM_OK;
+}
+
+/**
+ * Run a concurrent track.
+ *
+ * @param data  track data.
+ * @return      zero on success, or `-1` on error.
+ */
+static int exec_track_run(void *data) {
+    struct exec_track *track = data;
+    Jim_Interp *interp = track->interp;
+    track_set_wait(exec_wait_events, interp);
+    int ret = Jim_Eval(interp, track->body);
+    if (ret == JIM_ERR) {
+        Jim_MakeErrorMessage(interp);
+        log_message(-1, "track: %s", Jim_String(Jim_GetResult(interp)));
+    } else if (ret == JIM_EXIT && Jim_GetExitCode(interp) == 0)
+        ret = JIM_OK;
+    Jim_FreeInterp(interp);
+    free(track->body);
+    free(track);
+    return ret == JIM_OK || ret == JIM_RETURN ? 0 : -1;
+}
+
+/**
+ * Tcl command: track
+ */
+static int exec_track(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "body");
+        return JIM_ERR;
+    }
+    struct exec_track *track = malloc(sizeof(*track));
+    if (track == NULL || (track->body = strdup(Jim_String(argv[1]))) == NULL) {
+        free(track);
+        Jim_SetResultFormatted(interp, "cannot allocate track: %s", strerror(errno));
+        return JIM_ERR;
+    }
+    if ((track->interp = exec_create()) == NULL) {
+        free(track->body);
+        free(track);
+        Jim_SetResultFormatted(interp, "cannot create track interpreter");
+        return JIM_ERR;
+    }
+    Jim_Obj *sys_name = Jim_GetVariableStr(interp, "::udotool::sys_name", JIM_NONE);
+    if (sys_name != NULL)
+        Jim_SetVariableStrWithStr(track->interp, "::udotool::sys_name", Jim_String(sys_name));
+    if (track_spawn(exec_track_run, track) < 0) {
+        Jim_SetResultFormatted(interp, "cannot spawn track: %s", strerror(errno));
+        Jim_FreeInterp(track->interp);
+        free(track->body);
+        free(track);
+        return JIM_ERR;
+    }
+    Jim_SetEmptyResult(interp);
+    return JIM_OK;
+}
+
+/**
+ * Tcl command: stats
+ */
+static int exec_stats(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    static const char *const commands[] = { "reset", NULL };
+    if (argc > 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?reset?");
+        return JIM_ERR;
+    }
+    if (argc == 2) {
+        int cmd = 0;
+        if (Jim_GetEnum(interp, argv[1], commands, &cmd, "subcommand", JIM_ERRMSG|JIM_ENUM_ABBREV) != JIM_OK)
+            return JIM_ERR;
+        memset(&UINPUT_STATS, 0, sizeof(UINPUT_STATS));
+        Jim_SetEmptyResult(interp);
+        return JIM_OK;
+    }
+    // Take a snapshot, since building the result allocates
+    const struct udotool_stats snapshot = UINPUT_STATS, *st = &snapshot;
+    Jim_Obj *events = Jim_NewDictObj(interp, NULL, 0);
+    add_stat(interp, events, "SYN", Jim_NewIntObj(interp, (jim_wide)st->syn_events));
+    add_stat(interp, events, "KEY", Jim_NewIntObj(interp, (jim_wide)st->key_events));
+    add_stat(interp, events, "REL", Jim_NewIntObj(interp, (jim_wide)st->rel_events));
+    add_stat(interp, events, "ABS", Jim_NewIntObj(interp, (jim_wide)st->abs_events));
+    Jim_Obj *result = Jim_NewDictObj(interp, NULL, 0);
+    add_stat(interp, result, "events",       events);
+    add_stat(interp, result, "frames",       Jim_NewIntObj(interp, (jim_wide)st->frames));
+    add_stat(interp, result, "writes",       Jim_NewIntObj(interp, (jim_wide)st->writes));
+    add_stat(interp, result, "bytes",        Jim_NewIntObj(interp, (jim_wide)st->bytes));
+    add_stat(interp, result, "write_errors", Jim_NewIntObj(interp, (jim_wide)st->write_errors));
+    add_stat(interp, result, "write_time",   Jim_NewDoubleObj(interp, st->write_time));
+    add_stat(interp, result, "lookups",      Jim_NewIntObj(interp, (jim_wide)st->lookups));
+    add_stat(interp, result, "cache_hits",   Jim_NewIntObj(interp, (jim_wide)st->cache_hits));
+    add_stat(interp, result, "budgets",      Jim_NewIntObj(interp, (jim_wide)st->budgets));
+    add_stat(interp, result, "budget_overruns", Jim_NewIntObj(interp, (jim_wide)st->budget_overruns));
+    add_stat(interp, result, "budget_time",  Jim_NewDoubleObj(interp, st->budget_time));
+    add_stat(interp, result, "budget_max",   Jim_NewDoubleObj(interp, st->budget_max));
+    add_stat(interp, result, "allocations",  Jim_NewIntObj(interp, (jim_wide)st->allocations));
+    Jim_SetResult(interp, result);
+    return JIM_OK;
+}
+
+/**
+ * Tcl command: trace-dump
+ */
+static int exec_trace_dump(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "filename");
+        return JIM_ERR;
+    }
+    if (tracebin_dump(Jim_String(argv[1]), stdout) < 0) {
+        if (errno == 0)
+            Jim_SetResultFormatted(interp, "not a trace file: %#s", argv[1]);
+        else
+            Jim_SetResultFormatted(interp, "error reading trace file %#s: %s", argv[1], strerror(errno));
+        return JIM_ERR;
+    }
+    Jim_SetEmptyResult(interp);
+    return JIM_OK;
+}
+
+/**
+ * Compare file names (for `bsearch`).
+ *
+ * @param key   pointer to file name.
+ * @param elem  pointer to element of `SYSTEM_FILES`.
+ * @return      comparison result.
+ */
+static int compare_file(const void *key, const void *elem) {
+    return strcmp(*(const char *const*)key, *(const char *const*)elem);
+}
+
+/**
+ * Tcl command: ::internal::xtrace
+ *
+ * Execution trace callback. Arguments are: trace type, file name,
+ * line number, result, command, and list of arguments.
+ *
+ * This records current script line for binary trace, feeds script
+ * profiler, and prints executed commands: at level 1 for user scripts,
+ * and at level 3 for system files. Procedure calls (trace type `proc`)
+ * are not printed, since commands in their bodies are.
+ */
+static int exec_xtrace(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    if (argc < 7)
+        return JIM_OK;
+    const char *mode = Jim_String(argv[1]);
+    int is_cmd = strcmp(mode, "cmd") == 0;
+    if (!is_cmd && strcmp(mode, "proc") != 0)
+        return JIM_OK;
+    const char *fname = Jim_String(argv[2]);
+    int level = 1;
+    if (bsearch(&fname, SYSTEM_FILES, sizeof(SYSTEM_FILES)/sizeof(SYSTEM_FILES[0]),
+                sizeof(SYSTEM_FILES[0]), compare_file) != NULL)
+        level = 3;
+    int print = is_cmd && log_enabled(level);
+    if (level == 1 || print || CFG_PROFILE > 0) {
+        long line;
+        if (Jim_GetLong(interp, argv[3], &line) != JIM_OK)
+            line = 0;
+        if (level == 1 && line > 0)
+            TRACEBIN_LINE = (unsigned long)line;
+        if (CFG_PROFILE > 0)
+            profile_command(interp, fname, line, Jim_String(argv[5]));
+        if (print)
+            log_message(level, "[%s:%ld] %s %s", fname, line, Jim_String(argv[5]), Jim_String(argv[6]));
+    }
+    return JIM_OK;
+}
+
+/**
+ * Tcl command: budget
+ */
+static int exec_budget(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    static const char *const options[] = { "-report", NULL };
+    int ret, first = 1, opt = 0;
+
+    Jim_Obj *var_report = NULL;
+    for (; first + 1 < argc &&
+           Jim_GetEnum(interp, argv[first], options, &opt, NULL, JIM_NONE) == JIM_OK; first += 2) {
+        switch (opt) {
+        case 0: // -report
+            var_report = argv[first + 1];
+            break;
+        }
+    }
+    if (argc - first != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?-report varName? seconds body");
+        return JIM_ERR;
+    }
+    double budget;
+    if ((ret = Jim_GetDouble(interp, argv[first], &budget)) != JIM_OK)
+        return ret;
+    if (budget < 0 || budget > MAX_SLEEP_SEC) {
+        Jim_SetResultFormatted(interp, "budget out of range: %#s", argv[first]);
+        return JIM_ERR;
+    }
+
+    // Budgets are about host performance, so measure real time
+    double start = timing_real_now();
+    ret = Jim_EvalObj(interp, argv[first + 1]);
+    double duration = timing_real_now() - start;
+    int exceeded = duration > budget;
+    UINPUT_STATS.budgets++;
+    UINPUT_STATS.budget_time += duration;
+    if (duration > UINPUT_STATS.budget_max)
+        UINPUT_STATS.budget_max = duration;
+    if (exceeded)
+        UINPUT_STATS.budget_overruns++;
+    if (ret != JIM_OK)
+        return ret;
+
+    if (var_report != NULL) {
+        Jim_Obj *report = Jim_NewDictObj(interp, NULL, 0);
+        add_stat(interp, report, "budget",   Jim_NewDoubleObj(interp, budget));
+        add_stat(interp, report, "duration", Jim_NewDoubleObj(interp, duration));
+        add_stat(interp, report, "exceeded", Jim_NewIntObj(interp, exceeded));
+        return Jim_SetVariable(interp, var_report, report);
+    }
+    if (exceeded) {
+        Jim_Obj *took = Jim_NewDoubleObj(interp, duration);
+        Jim_IncrRefCount(took);
+        Jim_SetResultFormatted(interp, "budget of %#s seconds exceeded: took %#s seconds", argv[first], took);
+        Jim_DecrRefCount(interp, took);
+        return JIM_ERR;
+    }
+    Jim_SetEmptyResult(interp);
+    return JIM_OK;
+}
+
+/**
+ * Tcl command: batch
+ */
+static int exec_batch(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    int merge = 0;
+    if (argc == 3 && strcmp(Jim_String(argv[1]), "-frame") == 0)
+        merge = 1;
+    else if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?-frame? body");
+        return JIM_ERR;
+    }
+    uinput_batch_begin(merge);
+    int ret = Jim_EvalObj(interp, argv[argc - 1]);
+    if (uinput_batch_end(merge) < 0 && ret == JIM_OK) {
+        Jim_SetResultFormatted(interp, "device event error");
+        return JIM_ERR;
+    }
+    return ret;
+}
+
+/**
+ * Tcl command: type
+ */
+static int exec_type(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    static const char *const options[] = { "-keymap", "-rate", NULL };
+    int ret, first = 1, opt = 0;
+
+    const char *filename = NULL;
+    double rate = DEFAULT_TYPE_RATE;
+    for (; first + 1 < argc &&
+           Jim_GetEnum(interp, argv[first], options, &opt, NULL, JIM_NONE) == JIM_OK; first += 2) {
+        switch (opt) {
+        case 0: // -keymap
+            filename = Jim_String(argv[first + 1]);
+            break;
+        case 1: // -rate
+            if ((ret = Jim_GetDouble(interp, argv[first + 1], &rate)) != JIM_OK)
+                return ret;
+            if (rate < 0) {
+                Jim_SetResultFormatted(interp, "rate out of range: %#s", argv[first + 1]);
+                return JIM_ERR;
+            }
+            break;
+        }
+    }
+    if (argc - first != 1) {
+        Jim_WrongNumArgs(interp, 1, argv, "?-keymap filename? ?-rate cps? string");
+        return JIM_ERR;
+    }
+    if (filename == NULL) {
+        Jim_Obj *var = Jim_GetVariableStr(interp, "::udotool::keymap", JIM_NONE);
+        if (var == NULL) {
+            Jim_SetResultFormatted(interp, "no keymap: use option -keymap or variable ::udotool::keymap");
+            return JIM_ERR;
+        }
+        filename = Jim_String(var);
+    }
+
+    const struct keymap *map = keymap_load(filename);
+    if (map == NULL) {
+        if (errno == 0)
+            Jim_SetResultFormatted(interp, "error in keymap file %s", filename);
+        else
+            Jim_SetResultFormatted(interp, "error reading keymap file %s: %s", filename, strerror(errno));
+        return JIM_ERR;
+    }
+    const struct keymap_entry **seq = NULL;
+    size_t len = 0;
+    long bad = 0;
+    if (keymap_compile(map, Jim_String(argv[first]), &seq, &len, &bad) < 0) {
+        if (bad == -2)
+            Jim_SetResultFormatted(interp, "out of memory");
+        else if (bad < 0)
+            Jim_SetResultFormatted(interp, "invalid UTF-8 string: %#s", argv[first]);
+        else {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "U+%04lX", (unsigned long)bad);
+            Jim_SetResultFormatted(interp, "character %s is not in keymap %s", buffer, filename);
+        }
+        return JIM_ERR;
+    }
+    ret = keymap_type(seq, len, rate);
+    free(seq);
+    if (ret < 0) {
+        Jim_SetResultFormatted(interp, "device event error");
+        return JIM_ERR;
+    }
+    Jim_SetEmptyResult(interp);
+    return JIM_OK;
+}
+
+/**
+ * Tcl command: ::internal::scroll
+ *
+ * Smooth wheel scrolling: `delta` notches are split into evenly spaced
+ * steps over `seconds`, each step written as a separate frame. Relative
+ * axis accumulators take care of fractional steps and detents.
+ */
+static int exec_scroll(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    if (argc != 4) {
+        Jim_WrongNumArgs(interp, 1, argv, "axis delta seconds");
+        return JIM_ERR;
+    }
+    int axis, ret;
+    double delta = 0, duration = 0;
+    if ((axis = uinput_find_axis(Jim_String(argv[0]), Jim_String(argv[1]), UDOTOOL_AXIS_REL, NULL)) < 0) {
+        Jim_SetResultFormatted(interp, "unknown axis name \"%#s\"", argv[1]);
+        return JIM_ERR;
+    }
+    if ((ret = parse_rel_value(interp, argv[2], NULL, argv[2], &delta)) != JIM_OK)
+        return ret;
+    if ((ret = Jim_GetDouble(interp, argv[3], &duration)) != JIM_OK)
+        return ret;
+    if (duration < 0 || duration > MAX_SLEEP_SEC) {
+        Jim_SetResultFormatted(interp, "duration out of range: %#s", argv[3]);
+        return JIM_ERR;
+    }
+
+    // No faster than step rate, and no smaller than one (high-resolution) unit
+    int divisor = 1;
+    for (int i = 0; UINPUT_HIRES_AXIS[i].lo_axis >= 0; i++)
+        if (axis == UINPUT_HIRES_AXIS[i].lo_axis)
+            divisor = UINPUT_HIRES_AXIS[i].divisor;
+    double units = (delta < 0 ? -delta : delta)*divisor;
+    double steps = duration*SMOOTH_SCROLL_RATE;
+    if (steps > units)
+        steps = units;
+    long nsteps = steps < 1 ? 1 : (long)steps;
+    if (uinput_open() != 0) {
+        Jim_SetResultFormatted(interp, "device setup error");
+        return JIM_ERR;
+    }
+    double start = timing_now(), interval = duration/nsteps;
+    for (long n = 0; n < nsteps; n++) {
+        if (n > 0 && track_wait_until(start + n*interval) < 0) {
             Jim_SetResultFormatted(interp, "error when sleeping: %s", strerror(errno));
             return JIM_ERR;
         }
+        if (uinput_relop(axis, delta/nsteps, 1) < 0) {
+            Jim_SetResultFormatted(interp, "device event error");
+            return JIM_ERR;
+        }
+    }
+    Jim_SetEmptyResult(interp);
+    return JIM_OK;
+}
+
+/**
+ * Parse a motion path point.
+ *
+ * @param interp  interpreter.
+ * @param path    motion path (with axes already set).
+ * @param list    list of values, one per axis.
+ * @param raw     if not zero, absolute values are in device units.
+ * @param point   buffer for the point.
+ * @return        error code.
+ */
+static int parse_motion_point(Jim_Interp *interp, const struct motion_path *path, Jim_Obj *list,
+                              int raw, double *point) {
+    if (Jim_ListLength(interp, list) != path->naxes) {
+        Jim_SetResultFormatted(interp, "expected %d values in point \"%#s\"", path->naxes, list);
+        return JIM_ERR;
+    }
+    for (int k = 0; k < path->naxes; k++) {
+        Jim_Obj *value = Jim_ListGetIndex(interp, list, k);
+        if (path->abs_flag) {
+            int ival = 0;
+            if (parse_abs_value(interp, value, NULL, list, path->axes[k], raw, &ival) != JIM_OK)
+                return JIM_ERR;
+            point[k] = ival;
+        } else if (parse_rel_value(interp, value, NULL, list, &point[k]) != JIM_OK)
+            return JIM_ERR;
+    }
+    return JIM_OK;
+}
+
+/**
+ * Tcl command: ::internal::motion
+ *
+ * Interpolated motion along relative or absolute axes (see `motion_run()`).
+ */
+static int exec_motion(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    static const char *const options[] = { "-raw", "-duration", "-rate", "-curve", "-via", NULL };
+    struct motion_path path;
+    memset(&path, 0, sizeof(path));
+    path.curve    = MOTION_CURVE_LINEAR;
+    path.duration = DEFAULT_MOTION_TIME;
+    path.rate     = DEFAULT_MOTION_RATE;
+    Jim_Obj *via = NULL;
+    int ret, raw = 0, first = 1, opt = 0;
+
+    for (; first < argc - 2; first++) {
+        if ((ret = Jim_GetEnum(interp, argv[first], options, &opt, "option", JIM_ERRMSG)) != JIM_OK)
+            return ret;
+        if (opt == 0) { // -raw
+            raw = 1;
+            continue;
+        }
+        if (++first >= argc - 2) {
+            Jim_SetResultFormatted(interp, "option \"%#s\" requires a value", argv[first - 1]);
+            return JIM_ERR;
+        }
+        switch (opt) {
+        case 1: // -duration
+            if ((ret = Jim_GetDouble(interp, argv[first], &path.duration)) != JIM_OK)
+                return ret;
+            if (path.duration < 0 || path.duration > MAX_SLEEP_SEC) {
+                Jim_SetResultFormatted(interp, "duration out of range: %#s", argv[first]);
+                return JIM_ERR;
+            }
+            break;
+        case 2: // -rate
+            if ((ret = Jim_GetDouble(interp, argv[first], &path.rate)) != JIM_OK)
+                return ret;
+            if (path.rate < 1 || path.rate > MAX_MOTION_RATE) {
+                Jim_SetResultFormatted(interp, "rate out of range: %#s", argv[first]);
+                return JIM_ERR;
+            }
+            break;
+        case 3: // -curve
+            if ((ret = Jim_GetEnum(interp, argv[first], MOTION_CURVES, &path.curve, "curve", JIM_ERRMSG)) != JIM_OK)
+                return ret;
+            break;
+        case 4: // -via
+            via = argv[first];
+            break;
+        }
+    }
+    if (argc - first != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?-raw? ?-duration seconds? ?-rate fps? ?-curve curve? ?-via points? axes values");
+        return JIM_ERR;
+    }
+
+    Jim_Obj *axes = argv[first];
+    path.naxes = Jim_ListLength(interp, axes);
+    if (path.naxes < 1 || path.naxes > MOTION_MAX_AXES) {
+        Jim_SetResultFormatted(interp, "wrong number of axes: \"%#s\"", axes);
+        return JIM_ERR;
+    }
+    for (int k = 0; k < path.naxes; k++) {
+        Jim_Obj *name = Jim_ListGetIndex(interp, axes, k);
+        int abs_flag = 0;
+        if ((path.axes[k] = uinput_find_axis(Jim_String(argv[0]), Jim_String(name), UDOTOOL_AXIS_BOTH, &abs_flag)) < 0) {
+            Jim_SetResultFormatted(interp, "unknown axis name \"%#s\"", name);
+            return JIM_ERR;
+        }
+        if (k > 0 && abs_flag != path.abs_flag) {
+            Jim_SetResultFormatted(interp, "mixed relative and absolute axes: \"%#s\"", axes);
+            return JIM_ERR;
+        }
+        path.abs_flag = abs_flag;
+    }
+
+    int nvia = via != NULL ? Jim_ListLength(interp, via) : 0;
+    if (nvia > MOTION_MAX_VIA) {
+        Jim_SetResultFormatted(interp, "too many intermediate points (maximum is %d)", MOTION_MAX_VIA);
+        return JIM_ERR;
+    }
+    path.npoints = nvia + 2;
+    for (int i = 0; i < nvia; i++)
+        if (parse_motion_point(interp, &path, Jim_ListGetIndex(interp, via, i), raw, path.points[i + 1]) != JIM_OK)
+            return JIM_ERR;
+    if (parse_motion_point(interp, &path, argv[first + 1], raw, path.points[nvia + 1]) != JIM_OK)
+        return JIM_ERR;
+
+    if (motion_run(&path) < 0) {
+        Jim_SetResultFormatted(interp, "device event error");
+        return JIM_ERR;
     }
     Jim_SetEmptyResult(interp);
     return JIM_OK;
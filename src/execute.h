@@ -6,3 +6,4 @@
  */
 int exec_args(int argc, const char *const*argv);
 int exec_file(const char *filename);
+int exec_fast(int argc, const char *const*argv, int *pret);
@@ -0,0 +1,463 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Fast path for simple command lines
+ *
+ * A command line consisting of a single input emulation command with
+ * plain literal arguments is executed here directly, without creating
+ * a Tcl interpreter. Anything this code doesn't fully understand is
+ * left to the interpreter, so the fast path doesn't change behavior.
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "udotool.h"
+#include "execute.h"
+#include "uinput-func.h"
+#include "timing.h"
+
+#define FAST_MAX_ARGS 32  ///< Maximum number of command arguments.
+#define FAST_MAX_OPS  64  ///< Maximum number of operations in a command.
+
+/**
+ * Operation types.
+ */
+enum {
+    FAST_SYNC = 0,  ///< Sync report.
+    FAST_KEY,       ///< Key/button event.
+    FAST_REL,       ///< Relative axis event.
+    FAST_ABS,       ///< Absolute axis event.
+};
+
+/**
+ * Single operation.
+ */
+struct fast_op {
+    int    type;   ///< Operation type.
+    int    code;   ///< Key or axis code.
+    double value;  ///< Operation value.
+};
+
+/**
+ * Parsed command.
+ */
+struct fast_cmd {
+    int            open;      ///< Non-zero to open device before anything else.
+    long           rep_num;   ///< Number of repetitions, or negative for no limit.
+    double         rep_time;  ///< Repetition time limit, or zero for no limit.
+    double         delay;     ///< Delay after each repetition, or negative for none.
+    int            nops;      ///< Number of operations.
+    struct fast_op ops[FAST_MAX_OPS]; ///< Operations.
+};
+
+/**
+ * Command parser.
+ *
+ * @param argc  number of arguments (not including command name).
+ * @param argv  arguments (may be modified).
+ * @param cmd   parsed command buffer.
+ * @return      zero on success, or `-1` if fast path is not applicable.
+ */
+typedef int (*fast_parser_t)(int argc, const char **argv, struct fast_cmd *cmd);
+
+static int fast_input   (int argc, const char **argv, struct fast_cmd *cmd);
+static int fast_keydown (int argc, const char **argv, struct fast_cmd *cmd);
+static int fast_keyup   (int argc, const char **argv, struct fast_cmd *cmd);
+static int fast_key     (int argc, const char **argv, struct fast_cmd *cmd);
+static int fast_wheel   (int argc, const char **argv, struct fast_cmd *cmd);
+static int fast_move    (int argc, const char **argv, struct fast_cmd *cmd);
+static int fast_position(int argc, const char **argv, struct fast_cmd *cmd);
+
+/**
+ * Commands handled by fast path.
+ */
+static const struct fast_cmd_def {
+    const char   *name;   ///< Command name.
+    fast_parser_t parse;  ///< Command parser.
+} FAST_COMMANDS[] = {
+    { "input",    fast_input    },
+    { "keydown",  fast_keydown  },
+    { "keyup",    fast_keyup    },
+    { "key",      fast_key      },
+    { "wheel",    fast_wheel    },
+    { "move",     fast_move     },
+    { "position", fast_position },
+    { NULL }
+};
+
+/**
+ * Check that an argument is a plain literal.
+ *
+ * Arguments with characters special for Tcl list syntax are left
+ * to the interpreter.
+ *
+ * @param arg  argument.
+ * @return     non-zero if the argument is a plain literal.
+ */
+static int fast_is_literal(const char *arg) {
+    return arg[strcspn(arg, " \t\n\r\v\f{}[]\"\\$;")] == '\0';
+}
+
+/**
+ * Parse a plain decimal number.
+ *
+ * @param str   string to parse.
+ * @param pval  pointer to buffer for parsed value.
+ * @return      zero on success, or `-1` if not a plain number.
+ */
+static int fast_number(const char *str, double *pval) {
+    if (*str == '\0' || str[strspn(str, "0123456789+-.eE")] != '\0')
+        return -1;
+    char *ep = NULL;
+    errno = 0;
+    double value = strtod(str, &ep);
+    if (*ep != '\0' || errno != 0)
+        return -1;
+    *pval = value;
+    return 0;
+}
+
+/**
+ * Parse a plain decimal integer.
+ *
+ * @param str   string to parse.
+ * @param pval  pointer to buffer for parsed value.
+ * @return      zero on success, or `-1` if not a plain integer.
+ */
+static int fast_integer(const char *str, long *pval) {
+    if (*str == '\0' || str[strspn(str, "0123456789+-")] != '\0')
+        return -1;
+    char *ep = NULL;
+    errno = 0;
+    long value = strtol(str, &ep, 10);
+    if (*ep != '\0' || errno != 0)
+        return -1;
+    *pval = value;
+    return 0;
+}
+
+/**
+ * Extract an option from argument list.
+ *
+ * Like `::internal::getopt`, this removes the first occurrence
+ * of the option (and its value) anywhere in the list.
+ *
+ * @param pargc  pointer to number of arguments.
+ * @param argv   arguments.
+ * @param opt    option name.
+ * @param pval   if not `NULL`, pointer to buffer for option value.
+ * @return       `1` if found, `0` if not found, or `-1` on error.
+ */
+static int fast_getopt(int *pargc, const char **argv, const char *opt, const char **pval) {
+    int argc = *pargc, skip = pval != NULL ? 2 : 1;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], opt) != 0)
+            continue;
+        if (i + skip > argc)
+            return -1;
+        if (pval != NULL)
+            *pval = argv[i + 1];
+        memmove(&argv[i], &argv[i + skip], (argc - i - skip)*sizeof(argv[0]));
+        *pargc = argc - skip;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Append an operation to a command.
+ *
+ * @param cmd    command.
+ * @param type   operation type.
+ * @param code   key or axis code.
+ * @param value  operation value.
+ * @return       zero on success, or `-1` if there are too many operations.
+ */
+static int fast_add(struct fast_cmd *cmd, int type, int code, double value) {
+    if (cmd->nops >= FAST_MAX_OPS)
+        return -1;
+    struct fast_op *op = &cmd->ops[cmd->nops++];
+    op->type  = type;
+    op->code  = code;
+    op->value = value;
+    return 0;
+}
+
+/**
+ * Append an axis operation to a command.
+ *
+ * Values for absolute axes are converted to device units here.
+ *
+ * @param cmd    command.
+ * @param axis   axis name.
+ * @param value  axis value.
+ * @param raw    if not zero, absolute value is in device units.
+ * @return       zero on success, or `-1` if fast path is not applicable.
+ */
+static int fast_add_axis(struct fast_cmd *cmd, const char *axis, const char *value, int raw) {
+    int code, abs_flag = 0, is_int = 0;
+    double dval = 0;
+    long ival = 0;
+    if ((code = uinput_find_axis(NULL, axis, UDOTOOL_AXIS_BOTH, &abs_flag)) < 0)
+        return -1;
+    if (fast_integer(value, &ival) == 0 && ival >= INT_MIN && ival <= INT_MAX) {
+        dval = ival;
+        is_int = 1;
+    } else if (fast_number(value, &dval) < 0)
+        return -1;
+    if (abs_flag) {
+        int min = 0, max = 100;
+        if (raw) {
+            if (!is_int)
+                return -1;
+            uinput_abs_range(code, &min, &max);
+        }
+        if (dval < min || dval > max)
+            return -1;
+        return fast_add(cmd, FAST_ABS, code, raw ? ival : uinput_abs_scale(code, dval));
+    }
+    if (raw || dval < INT_MIN || dval > INT_MAX)
+        return -1;
+    return fast_add(cmd, FAST_REL, code, dval);
+}
+
+/**
+ * Append a key operation to a command.
+ *
+ * @param cmd    command.
+ * @param key    key name.
+ * @param value  `1` for key down, or `0` for key up.
+ * @return       zero on success, or `-1` if fast path is not applicable.
+ */
+static int fast_add_key(struct fast_cmd *cmd, const char *key, int value) {
+    int code;
+    if ((code = uinput_find_key(NULL, key)) < 0)
+        return -1;
+    return fast_add(cmd, FAST_KEY, code, value);
+}
+
+/**
+ * Fast path: input
+ */
+static int fast_input(int argc, const char **argv, struct fast_cmd *cmd) {
+    char axis[MAX_OBJECT_NAME];
+    int first = 0, raw = 0;
+    if (argc > 0 && strcmp(argv[0], "-raw") == 0) {
+        raw = 1;
+        first++;
+    }
+    for (int n = first; n < argc; n++) {
+        const char *arg = argv[n];
+        const char *sep = strchr(arg, '=');
+        size_t len = sep != NULL ? (size_t)(sep - arg) : strlen(arg);
+        if (len == 0 || len >= sizeof(axis))
+            return -1;
+        memcpy(axis, arg, len);
+        axis[len] = '\0';
+        int ret;
+        if (strcasecmp(axis, "SYNC") == 0)
+            ret = fast_add(cmd, FAST_SYNC, 0, 0);
+        else if (sep == NULL)
+            ret = -1;
+        else if (strcasecmp(axis, "KEYDOWN") == 0)
+            ret = fast_add_key(cmd, sep + 1, 1);
+        else if (strcasecmp(axis, "KEYUP") == 0)
+            ret = fast_add_key(cmd, sep + 1, 0);
+        else
+            ret = fast_add_axis(cmd, axis, sep + 1, raw);
+        if (ret < 0)
+            return -1;
+    }
+    return fast_add(cmd, FAST_SYNC, 0, 0);
+}
+
+/**
+ * Fast path: keydown
+ */
+static int fast_keydown(int argc, const char **argv, struct fast_cmd *cmd) {
+    for (int n = 0; n < argc; n++)
+        if (fast_add_key(cmd, argv[n], 1) < 0 || fast_add(cmd, FAST_SYNC, 0, 0) < 0)
+            return -1;
+    return fast_add(cmd, FAST_SYNC, 0, 0);
+}
+
+/**
+ * Fast path: keyup
+ */
+static int fast_keyup(int argc, const char **argv, struct fast_cmd *cmd) {
+    for (int n = argc - 1; n >= 0; n--)
+        if (fast_add_key(cmd, argv[n], 0) < 0 || fast_add(cmd, FAST_SYNC, 0, 0) < 0)
+            return -1;
+    return fast_add(cmd, FAST_SYNC, 0, 0);
+}
+
+/**
+ * Fast path: key
+ */
+static int fast_key(int argc, const char **argv, struct fast_cmd *cmd) {
+    const char *rep_num = NULL, *rep_time = NULL, *rep_delay = NULL;
+    if (fast_getopt(&argc, argv, "-repeat", &rep_num) < 0 ||
+        fast_getopt(&argc, argv, "-time", &rep_time) < 0 ||
+        fast_getopt(&argc, argv, "-delay", &rep_delay) < 0)
+        return -1;
+    cmd->rep_num = 0;
+    cmd->delay = DEFAULT_KEY_DELAY;
+    if ((rep_num != NULL && fast_integer(rep_num, &cmd->rep_num) < 0) ||
+        (rep_time != NULL && fast_number(rep_time, &cmd->rep_time) < 0) ||
+        (rep_delay != NULL && fast_number(rep_delay, &cmd->delay) < 0))
+        return -1;
+    if (cmd->rep_time < 0 || cmd->rep_time > MAX_SLEEP_SEC ||
+        cmd->delay < 0 || cmd->delay > MAX_SLEEP_SEC)
+        return -1;
+    if (cmd->rep_num == 0)
+        cmd->rep_num = cmd->rep_time <= 0 ? 1 : -1;
+    cmd->open = 1;
+    for (int n = 0; n < argc; n++)
+        if (fast_add_key(cmd, argv[n], 1) < 0)
+            return -1;
+    if (fast_add(cmd, FAST_SYNC, 0, 0) < 0)
+        return -1;
+    for (int n = argc - 1; n >= 0; n--)
+        if (fast_add_key(cmd, argv[n], 0) < 0)
+            return -1;
+    return fast_add(cmd, FAST_SYNC, 0, 0);
+}
+
+/**
+ * Fast path: wheel
+ */
+static int fast_wheel(int argc, const char **argv, struct fast_cmd *cmd) {
+    int hflag = fast_getopt(&argc, argv, "-h", NULL);
+    if (argc != 1 || fast_add_axis(cmd, hflag ? "REL_HWHEEL" : "REL_WHEEL", argv[0], 0) < 0)
+        return -1;
+    return fast_add(cmd, FAST_SYNC, 0, 0);
+}
+
+/**
+ * Common part of fast paths for move and position.
+ *
+ * @param argc    number of arguments.
+ * @param argv    arguments.
+ * @param cmd     parsed command buffer.
+ * @param prefix  axis name prefix.
+ * @param rprefix axis name prefix for option `-r`.
+ * @return        zero on success, or `-1` if fast path is not applicable.
+ */
+static int fast_xyz(int argc, const char **argv, struct fast_cmd *cmd,
+                    const char *prefix, const char *rprefix) {
+    static const char *const AXES[] = { "X", "Y", "Z" };
+    if (fast_getopt(&argc, argv, "-r", NULL) > 0)
+        prefix = rprefix;
+    int raw = fast_getopt(&argc, argv, "-raw", NULL) > 0;
+    raw |= fast_getopt(&argc, argv, "-px", NULL) > 0;
+    if (argc < 1 || argc > 3)
+        return -1;
+    char axis[MAX_OBJECT_NAME];
+    for (int n = 0; n < argc && argv[n][0] != '\0'; n++) {
+        snprintf(axis, sizeof(axis), "%s%s", prefix, AXES[n]);
+        if (fast_add_axis(cmd, axis, argv[n], raw) < 0)
+            return -1;
+    }
+    return fast_add(cmd, FAST_SYNC, 0, 0);
+}
+
+/**
+ * Fast path: move
+ */
+static int fast_move(int argc, const char **argv, struct fast_cmd *cmd) {
+    return fast_xyz(argc, argv, cmd, "REL_", "REL_R");
+}
+
+/**
+ * Fast path: position
+ */
+static int fast_position(int argc, const char **argv, struct fast_cmd *cmd) {
+    return fast_xyz(argc, argv, cmd, "ABS_", "ABS_R");
+}
+
+/**
+ * Emit all operations of a command.
+ *
+ * @param cmd  command.
+ * @return     zero on success, or `-1` on error.
+ */
+static int fast_emit(const struct fast_cmd *cmd) {
+    for (int i = 0; i < cmd->nops; i++) {
+        const struct fast_op *op = &cmd->ops[i];
+        int ret = 0;
+        switch (op->type) {
+        case FAST_SYNC:
+            ret = uinput_sync();
+            break;
+        case FAST_KEY:
+            ret = uinput_keyop(op->code, (int)op->value, 0);
+            break;
+        case FAST_REL:
+            ret = uinput_relop(op->code, op->value, 0);
+            break;
+        case FAST_ABS:
+            ret = uinput_absop_raw(op->code, (int)op->value, 0);
+            break;
+        }
+        if (ret < 0) {
+            log_message(-1, "device event error");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Try to execute a command line without Tcl interpreter.
+ *
+ * This is used only when debug tracing and script profiling are off,
+ * since the interpreter traces and profiles executed commands.
+ *
+ * @param argc  number of arguments.
+ * @param argv  arguments.
+ * @param pret  pointer to buffer for exit code.
+ * @return      non-zero if the command line was handled.
+ */
+int exec_fast(int argc, const char *const*argv, int *pret) {
+    if (CFG_VERBOSITY > 0 || CFG_PROFILE > 0 || argc < 1 || argc - 1 > FAST_MAX_ARGS)
+        return 0;
+    const struct fast_cmd_def *def;
+    for (def = FAST_COMMANDS; def->name != NULL; def++)
+        if (strcmp(def->name, argv[0]) == 0)
+            break;
+    if (def->name == NULL)
+        return 0;
+    const char *args[FAST_MAX_ARGS];
+    for (int i = 1; i < argc; i++) {
+        if (!fast_is_literal(argv[i]))
+            return 0;
+        args[i - 1] = argv[i];
+    }
+    struct fast_cmd cmd = { .open = 0, .rep_num = 1, .rep_time = 0, .delay = -1, .nops = 0 };
+    if ((*def->parse)(argc - 1, args, &cmd) < 0)
+        return 0;
+
+    log_message(2, "FAST: executing command '%s'", argv[0]);
+    *pret = -1;
+    if (cmd.open && uinput_open() != 0) {
+        log_message(-1, "device setup error");
+        return 1;
+    }
+    double start_ts = timing_now();
+    for (long rep = 0; cmd.rep_num < 0 || rep < cmd.rep_num; rep++) {
+        if (rep > 0 && cmd.rep_time != 0 && timing_now() >= start_ts + cmd.rep_time)
+            break;
+        if (fast_emit(&cmd) < 0)
+            return 1;
+        if (cmd.delay >= 0 && timing_sleep(cmd.delay) < 0) {
+            log_message(-1, "error when sleeping: %s", strerror(errno));
+            return 1;
+        }
+    }
+    *pret = 0;
+    return 1;
+}
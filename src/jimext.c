@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Jim extension loading
+ *
+ * Normally all extensions compiled into Jim library are initialized
+ * at startup. In lean mode (option `--lean`) only extensions needed
+ * by udotool itself, or defining subcommands of core commands, are
+ * initialized at startup. Others are initialized on first use of
+ * their commands (through command `unknown`) or on `package require`.
+ * Extensions not listed here (for example, `ensemble`) are unknown to
+ * lean mode, so on first use of an unknown command or package all
+ * remaining extensions are initialized at once.
+ *
+ * Extension init functions are referenced weakly, so extensions
+ * missing from the library are just skipped.
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#include <string.h>
+
+#include <jim.h>
+
+#include "udotool.h"
+#include "jimext.h"
+
+/**
+ * Extension init function.
+ */
+typedef int jimext_init_t(Jim_Interp *interp);
+
+#define DECLARE_EXT(N) extern jimext_init_t Jim_##N##Init __attribute__((weak))
+#define EAGER_EXT(N)      { #N, Jim_##N##Init, NULL }
+#define LAZY_EXT(N, CMDS) { #N, Jim_##N##Init, CMDS }
+
+DECLARE_EXT(bootstrap);
+DECLARE_EXT(aio);
+DECLARE_EXT(eventloop);
+DECLARE_EXT(signal);
+DECLARE_EXT(package);
+DECLARE_EXT(stdlib);
+DECLARE_EXT(tclcompat);
+DECLARE_EXT(nshelper);
+DECLARE_EXT(array);
+DECLARE_EXT(binary);
+DECLARE_EXT(clock);
+DECLARE_EXT(exec);
+DECLARE_EXT(file);
+DECLARE_EXT(glob);
+DECLARE_EXT(history);
+DECLARE_EXT(interp);
+DECLARE_EXT(json);
+DECLARE_EXT(load);
+DECLARE_EXT(oo);
+DECLARE_EXT(pack);
+DECLARE_EXT(posix);
+DECLARE_EXT(readdir);
+DECLARE_EXT(regexp);
+DECLARE_EXT(syslog);
+DECLARE_EXT(tclprefix);
+DECLARE_EXT(tree);
+DECLARE_EXT(zlib);
+
+/**
+ * Known extensions.
+ *
+ * Extensions without a list of commands are initialized eagerly.
+ * These are extensions that udotool needs (channels, event loop),
+ * extensions that define or override commands udotool overrides
+ * (`sleep`), and extensions that add subcommands to core commands
+ * (such subcommands cannot trigger `unknown`).
+ */
+static const struct jimext_def {
+    const char    *name;      ///< Extension (package) name.
+    jimext_init_t *init;      ///< Init function, or `NULL` if not available.
+    const char    *commands;  ///< Space-separated list of commands, or `NULL` for eager init.
+} JIMEXT_LIST[] = {
+    EAGER_EXT(bootstrap),
+    EAGER_EXT(aio),
+    EAGER_EXT(eventloop),
+    EAGER_EXT(signal),
+    EAGER_EXT(package),
+    EAGER_EXT(stdlib),
+    EAGER_EXT(tclcompat),
+    EAGER_EXT(nshelper),
+    LAZY_EXT(array,     "array"),
+    LAZY_EXT(binary,    "binary"),
+    LAZY_EXT(clock,     "clock"),
+    LAZY_EXT(exec,      "exec"),
+    LAZY_EXT(file,      "file pwd cd"),
+    LAZY_EXT(readdir,   "readdir"),
+    LAZY_EXT(glob,      "glob"),
+    LAZY_EXT(history,   "history"),
+    LAZY_EXT(interp,    "interp"),
+    LAZY_EXT(json,      "json::encode json::decode"),
+    LAZY_EXT(load,      "load"),
+    LAZY_EXT(oo,        "class super"),
+    LAZY_EXT(pack,      "pack unpack"),
+    LAZY_EXT(posix,     "pid os.fork os.wait os.gethostname os.getids os.uptime"),
+    LAZY_EXT(regexp,    "regexp regsub"),
+    LAZY_EXT(syslog,    "syslog"),
+    LAZY_EXT(tclprefix, "tcl::prefix"),
+    LAZY_EXT(tree,      "tree"),
+    LAZY_EXT(zlib,      "zlib"),
+    { NULL }
+};
+
+/**
+ * Number of known extensions.
+ */
+#define JIMEXT_COUNT (sizeof(JIMEXT_LIST)/sizeof(JIMEXT_LIST[0]) - 1)
+
+/**
+ * Flag in set of loaded extensions: all extensions are initialized.
+ */
+#define JIMEXT_ALL (1UL << JIMEXT_COUNT)
+
+/**
+ * Association key for per-interpreter set of loaded extensions.
+ */
+static const char JIMEXT_ASSOC[] = "udotool:jimext";
+
+/**
+ * Name of the renamed original `package` command.
+ */
+static const char JIMEXT_PACKAGE[] = "::internal::package";
+
+/**
+ * Check whether a word is in a space-separated list.
+ *
+ * @param list  space-separated list.
+ * @param word  word to look for.
+ * @return      non-zero if found.
+ */
+static int jimext_in_list(const char *list, const char *word) {
+    size_t len = strlen(word);
+    while (*list != '\0') {
+        size_t wlen = strcspn(list, " ");
+        if (wlen == len && memcmp(list, word, len) == 0)
+            return 1;
+        list += wlen;
+        list += strspn(list, " ");
+    }
+    return 0;
+}
+
+/**
+ * Initialize an extension, unless already done.
+ *
+ * @param interp  interpreter.
+ * @param ext     extension.
+ * @return        `1` if the extension was initialized now,
+ *                `0` if it was already initialized or not available,
+ *                or `-1` on error.
+ */
+static int jimext_load(Jim_Interp *interp, const struct jimext_def *ext) {
+    unsigned long *loaded = Jim_GetAssocData(interp, JIMEXT_ASSOC);
+    unsigned long mask = 1UL << (ext - JIMEXT_LIST);
+    if (ext->init == NULL || loaded == NULL || (*loaded & mask) != 0)
+        return 0;
+    *loaded |= mask;
+    log_message(2, "JIM: initializing extension %s", ext->name);
+    return (*ext->init)(interp) == JIM_OK ? 1 : -1;
+}
+
+/**
+ * Initialize all extensions compiled into Jim library, unless already done.
+ *
+ * This is the fallback for extensions not listed in `JIMEXT_LIST`.
+ * Init functions of extensions initialized before refuse to provide
+ * their packages again, and do nothing.
+ *
+ * @param interp  interpreter.
+ * @return        `1` if extensions were initialized now, or `0` if already done.
+ */
+static int jimext_load_all(Jim_Interp *interp) {
+    unsigned long *loaded = Jim_GetAssocData(interp, JIMEXT_ASSOC);
+    if (loaded == NULL || (*loaded & JIMEXT_ALL) != 0)
+        return 0;
+    *loaded = JIMEXT_ALL | (JIMEXT_ALL - 1);
+    log_message(2, "JIM: initializing all extensions");
+    Jim_InitStaticExtensions(interp);
+    Jim_SetEmptyResult(interp);
+    return 1;
+}
+
+/**
+ * Tcl command: unknown
+ *
+ * Initializes the extension that provides the missing command,
+ * and executes the command. If no known extension provides it,
+ * initializes all extensions, in case one of them does.
+ */
+static int jimext_unknown(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    if (argc < 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "cmd ?arg ...?");
+        return JIM_ERR;
+    }
+    const char *name = Jim_String(argv[1]);
+    for (const struct jimext_def *ext = JIMEXT_LIST; ext->name != NULL; ext++) {
+        if (ext->commands == NULL || !jimext_in_list(ext->commands, name))
+            continue;
+        int ret = jimext_load(interp, ext);
+        if (ret < 0)
+            return JIM_ERR;
+        if (ret > 0)
+            return Jim_EvalObjVector(interp, argc - 1, argv + 1);
+        goto ON_UNKN_CMD;
+    }
+    if (jimext_load_all(interp) > 0 && Jim_GetCommand(interp, argv[1], JIM_NONE) != NULL)
+        return Jim_EvalObjVector(interp, argc - 1, argv + 1);
+ON_UNKN_CMD:
+    Jim_SetResultFormatted(interp, "invalid command name \"%#s\"", argv[1]);
+    return JIM_ERR;
+}
+
+/**
+ * Tcl command: package (wrapper)
+ *
+ * Initializes extension requested by `package require` (or all
+ * extensions, if the package is not a known extension), and then
+ * passes control to the original command.
+ */
+static int jimext_package(Jim_Interp *interp, int argc, Jim_Obj *const*argv) {
+    if (argc >= 3 && strcmp(Jim_String(argv[1]), "require") == 0) {
+        const char *name = Jim_String(argv[2]);
+        const struct jimext_def *ext;
+        for (ext = JIMEXT_LIST; ext->name != NULL; ext++)
+            if (strcmp(ext->name, name) == 0) {
+                if (jimext_load(interp, ext) < 0)
+                    return JIM_ERR;
+                break;
+            }
+        if (ext->name == NULL)
+            jimext_load_all(interp);
+    }
+    return Jim_EvalObjPrefix(interp, Jim_NewStringObj(interp, JIMEXT_PACKAGE, -1), argc - 1, argv + 1);
+}
+
+/**
+ * Free per-interpreter set of loaded extensions.
+ *
+ * @param interp  interpreter.
+ * @param data    set to free.
+ */
+static void jimext_free(Jim_Interp *interp, void *data) {
+    (void)interp;
+    Jim_Free(data);
+}
+
+/**
+ * Initialize Jim extensions.
+ *
+ * @param interp  interpreter.
+ * @return        error code.
+ */
+int jimext_init(Jim_Interp *interp) {
+    if (!CFG_LEAN_INIT)
+        return Jim_InitStaticExtensions(interp);
+
+    unsigned long *loaded = Jim_Alloc(sizeof(*loaded));
+    *loaded = 0;
+    Jim_SetAssocData(interp, JIMEXT_ASSOC, jimext_free, loaded);
+    int ret;
+    if ((ret = Jim_CreateCommand(interp, "unknown", jimext_unknown, NULL, NULL)) != JIM_OK)
+        return ret;
+    for (const struct jimext_def *ext = JIMEXT_LIST; ext->name != NULL; ext++)
+        if (ext->commands == NULL && jimext_load(interp, ext) < 0)
+            return JIM_ERR;
+    Jim_Obj *name = Jim_NewStringObj(interp, "package", -1);
+    Jim_Obj *new_name = Jim_NewStringObj(interp, JIMEXT_PACKAGE, -1);
+    if (Jim_RenameCommand(interp, name, new_name) == JIM_OK) {
+        if ((ret = Jim_CreateCommand(interp, "package", jimext_package, NULL, NULL)) != JIM_OK)
+            return ret;
+    }
+    Jim_SetEmptyResult(interp);
+    return JIM_OK;
+}
@@ -0,0 +1,7 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Jim extension loading declarations
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+int jimext_init(Jim_Interp *interp);
@@ -0,0 +1,657 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Keyboard layout
+ *
+ * Keymap tells which key (and which modifier keys) produces each
+ * character. Keymaps are loaded from files of two formats:
+ *
+ * - Simple table: each line contains a character, a key name, and
+ *   optional modifier key names, separated by whitespace. Character is
+ *   either the character itself, or its Unicode code point (`U+20AC`),
+ *   or its XKB keysym name (`numbersign`). Lines starting with `#`
+ *   are comments.
+ * - XKB keymap, as printed by `xkbcomp` or `xkbcli compile-keymap`.
+ *   Only key codes and the first group of key symbols are used, and
+ *   levels are assumed to be: plain, Shift, AltGr, Shift+AltGr.
+ *
+ * Loaded keymaps are kept until exit, so each file is parsed only once.
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/uinput.h>
+
+#include "udotool.h"
+#include "keymap.h"
+#include "uinput-func.h"
+#include "timing.h"
+#include "track.h"
+
+#define KEYMAP_XKB_OFFSET 8   ///< Difference between XKB and evdev key codes.
+#define KEYMAP_MAX_LEVELS 4   ///< Number of XKB shift levels used.
+
+/**
+ * Loaded keymap.
+ */
+struct keymap {
+    struct keymap       *next;      ///< Next loaded keymap.
+    char                *filename;  ///< Keymap file name.
+    struct keymap_entry *entries;   ///< Entries (sorted by code point after loading).
+    size_t               count;     ///< Number of entries.
+    size_t               size;      ///< Allocated number of entries.
+};
+
+/**
+ * XKB key name.
+ */
+struct keymap_keyname {
+    char name[16];  ///< Key name (without angle brackets).
+    int  code;      ///< XKB key code.
+};
+
+/**
+ * List of loaded keymaps.
+ */
+static struct keymap *KEYMAP_LOADED = NULL;
+
+/**
+ * Modifier keys for XKB shift levels.
+ */
+static const unsigned short KEYMAP_LEVEL_MODS[KEYMAP_MAX_LEVELS][2] = {
+    { 0,            0 },
+    { KEY_LEFTSHIFT, 0 },
+    { KEY_RIGHTALT,  0 },
+    { KEY_LEFTSHIFT, KEY_RIGHTALT },
+};
+
+/**
+ * XKB keysym names for characters, except letters and digits.
+ */
+static const struct udotool_obj_id KEYMAP_KEYSYMS[] = {
+    { "Tab", 0x09 }, { "Return", 0x0A }, { "KP_Enter", 0x0A },
+    { "space", 0x20 }, { "exclam", 0x21 }, { "quotedbl", 0x22 }, { "numbersign", 0x23 },
+    { "dollar", 0x24 }, { "percent", 0x25 }, { "ampersand", 0x26 }, { "apostrophe", 0x27 },
+    { "parenleft", 0x28 }, { "parenright", 0x29 }, { "asterisk", 0x2A }, { "plus", 0x2B },
+    { "comma", 0x2C }, { "minus", 0x2D }, { "period", 0x2E }, { "slash", 0x2F },
+    { "colon", 0x3A }, { "semicolon", 0x3B }, { "less", 0x3C }, { "equal", 0x3D },
+    { "greater", 0x3E }, { "question", 0x3F }, { "at", 0x40 },
+    { "bracketleft", 0x5B }, { "backslash", 0x5C }, { "bracketright", 0x5D },
+    { "asciicircum", 0x5E }, { "underscore", 0x5F }, { "grave", 0x60 },
+    { "braceleft", 0x7B }, { "bar", 0x7C }, { "braceright", 0x7D }, { "asciitilde", 0x7E },
+    { "nobreakspace", 0xA0 }, { "exclamdown", 0xA1 }, { "cent", 0xA2 }, { "sterling", 0xA3 },
+    { "currency", 0xA4 }, { "yen", 0xA5 }, { "brokenbar", 0xA6 }, { "section", 0xA7 },
+    { "diaeresis", 0xA8 }, { "copyright", 0xA9 }, { "ordfeminine", 0xAA },
+    { "guillemotleft", 0xAB }, { "guillemetleft", 0xAB }, { "notsign", 0xAC },
+    { "hyphen", 0xAD }, { "registered", 0xAE }, { "macron", 0xAF }, { "degree", 0xB0 },
+    { "plusminus", 0xB1 }, { "twosuperior", 0xB2 }, { "threesuperior", 0xB3 },
+    { "acute", 0xB4 }, { "mu", 0xB5 }, { "paragraph", 0xB6 }, { "periodcentered", 0xB7 },
+    { "cedilla", 0xB8 }, { "onesuperior", 0xB9 }, { "masculine", 0xBA },
+    { "ordmasculine", 0xBA }, { "guillemotright", 0xBB }, { "guillemetright", 0xBB },
+    { "onequarter", 0xBC }, { "onehalf", 0xBD }, { "threequarters", 0xBE },
+    { "questiondown", 0xBF }, { "Agrave", 0xC0 }, { "Aacute", 0xC1 }, { "Acircumflex", 0xC2 },
+    { "Atilde", 0xC3 }, { "Adiaeresis", 0xC4 }, { "Aring", 0xC5 }, { "AE", 0xC6 },
+    { "Ccedilla", 0xC7 }, { "Egrave", 0xC8 }, { "Eacute", 0xC9 }, { "Ecircumflex", 0xCA },
+    { "Ediaeresis", 0xCB }, { "Igrave", 0xCC }, { "Iacute", 0xCD }, { "Icircumflex", 0xCE },
+    { "Idiaeresis", 0xCF }, { "ETH", 0xD0 }, { "Eth", 0xD0 }, { "Ntilde", 0xD1 },
+    { "Ograve", 0xD2 }, { "Oacute", 0xD3 }, { "Ocircumflex", 0xD4 }, { "Otilde", 0xD5 },
+    { "Odiaeresis", 0xD6 }, { "multiply", 0xD7 }, { "Oslash", 0xD8 }, { "Ooblique", 0xD8 },
+    { "Ugrave", 0xD9 }, { "Uacute", 0xDA }, { "Ucircumflex", 0xDB }, { "Udiaeresis", 0xDC },
+    { "Yacute", 0xDD }, { "THORN", 0xDE }, { "Thorn", 0xDE }, { "ssharp", 0xDF },
+    { "agrave", 0xE0 }, { "aacute", 0xE1 }, { "acircumflex", 0xE2 }, { "atilde", 0xE3 },
+    { "adiaeresis", 0xE4 }, { "aring", 0xE5 }, { "ae", 0xE6 }, { "ccedilla", 0xE7 },
+    { "egrave", 0xE8 }, { "eacute", 0xE9 }, { "ecircumflex", 0xEA }, { "ediaeresis", 0xEB },
+    { "igrave", 0xEC }, { "iacute", 0xED }, { "icircumflex", 0xEE }, { "idiaeresis", 0xEF },
+    { "eth", 0xF0 }, { "ntilde", 0xF1 }, { "ograve", 0xF2 }, { "oacute", 0xF3 },
+    { "ocircumflex", 0xF4 }, { "otilde", 0xF5 }, { "odiaeresis", 0xF6 }, { "division", 0xF7 },
+    { "oslash", 0xF8 }, { "ooblique", 0xF8 }, { "ugrave", 0xF9 }, { "uacute", 0xFA },
+    { "ucircumflex", 0xFB }, { "udiaeresis", 0xFC }, { "yacute", 0xFD }, { "thorn", 0xFE },
+    { "ydiaeresis", 0xFF }, { "EuroSign", 0x20AC },
+    { NULL, 0 }
+};
+
+/**
+ * Decode a UTF-8 character.
+ *
+ * @param ps  pointer to string pointer; advanced past the character.
+ * @return    code point, or `-1` if the string is not valid UTF-8.
+ */
+static long keymap_utf8(const char **ps) {
+    const unsigned char *sp = (const unsigned char *)*ps;
+    long value;
+    int extra;
+    if (*sp < 0x80) {
+        value = *sp;
+        extra = 0;
+    } else if ((*sp & 0xE0) == 0xC0) {
+        value = *sp & 0x1F;
+        extra = 1;
+    } else if ((*sp & 0xF0) == 0xE0) {
+        value = *sp & 0x0F;
+        extra = 2;
+    } else if ((*sp & 0xF8) == 0xF0) {
+        value = *sp & 0x07;
+        extra = 3;
+    } else
+        return -1;
+    for (sp++; extra > 0; extra--, sp++) {
+        if ((*sp & 0xC0) != 0x80)
+            return -1;
+        value = (value << 6) | (*sp & 0x3F);
+    }
+    *ps = (const char *)sp;
+    return value;
+}
+
+/**
+ * Convert a keysym to a code point.
+ *
+ * Keysym is either a single character, or a Unicode code point
+ * (`U20AC` or `U+20AC`), or a numeric keysym (`0x20ac`), or a name.
+ *
+ * @param name  keysym.
+ * @return      code point, or `-1` if unknown.
+ */
+static long keymap_keysym(const char *name) {
+    const char *sp = name, *ep = NULL;
+    long value = keymap_utf8(&sp);
+    if (value > 0 && *sp == '\0')
+        return value;
+    if (name[0] == 'U' && name[1] != '\0') {
+        // Names like "Uacute" are not code points
+        sp = name[1] == '+' ? name + 2 : name + 1;
+        value = strtol(sp, (char **)&ep, 16);
+        if (ep != sp && *ep == '\0')
+            return value > 0 && value <= 0x10FFFF ? value : -1;
+    }
+    if (name[0] == '0' && name[1] == 'x') {
+        value = strtol(name, (char **)&ep, 16);
+        if (ep == name || *ep != '\0')
+            return -1;
+        if ((value >= 0x20 && value <= 0x7E) || (value >= 0xA0 && value <= 0xFF))
+            return value;
+        if (value > 0x1000000 && value <= 0x110FFFF)
+            return value - 0x1000000;
+        return -1;
+    }
+    for (const struct udotool_obj_id *idptr = KEYMAP_KEYSYMS; idptr->name != NULL; idptr++)
+        if (strcmp(idptr->name, name) == 0)
+            return idptr->value;
+    return -1;
+}
+
+/**
+ * Add an entry to a keymap.
+ *
+ * If the code point is already present, the entry with fewer modifier
+ * keys is kept (or the earlier one, if equal).
+ *
+ * @param map    keymap.
+ * @param entry  entry to add.
+ * @return       zero on success, or `-1` on error.
+ */
+static int keymap_add(struct keymap *map, const struct keymap_entry *entry) {
+    for (size_t i = 0; i < map->count; i++) {
+        if (map->entries[i].codepoint != entry->codepoint)
+            continue;
+        if (map->entries[i].nmods > entry->nmods)
+            map->entries[i] = *entry;
+        return 0;
+    }
+    if (map->count == map->size) {
+        size_t size = map->size == 0 ? 128 : map->size*2;
+        struct keymap_entry *entries = realloc(map->entries, size*sizeof(*entries));
+        if (entries == NULL)
+            return -1;
+        map->entries = entries;
+        map->size    = size;
+    }
+    map->entries[map->count++] = *entry;
+    return 0;
+}
+
+/**
+ * Parse a simple table keymap.
+ *
+ * @param map       keymap.
+ * @param filename  file name (for messages).
+ * @param text      file contents (modified).
+ * @return          zero on success, or `-1` on error.
+ */
+static int keymap_parse_table(struct keymap *map, const char *filename, char *text) {
+    static const char SEP[] = " \t\r";
+    int lineno = 0;
+    for (char *line = text, *next; line != NULL; line = next) {
+        lineno++;
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+        char *save = NULL;
+        char *field = strtok_r(line, SEP, &save);
+        if (field == NULL || field[0] == '#')
+            continue;
+        struct keymap_entry entry;
+        memset(&entry, 0, sizeof(entry));
+        long value = keymap_keysym(field);
+        if (value < 0) {
+            log_message(-1, "KEYMAP: %s:%d: unknown character '%s'", filename, lineno, field);
+            errno = 0;
+            return -1;
+        }
+        entry.codepoint = value;
+        if ((field = strtok_r(NULL, SEP, &save)) == NULL) {
+            log_message(-1, "KEYMAP: %s:%d: missing key name", filename, lineno);
+            errno = 0;
+            return -1;
+        }
+        int key = uinput_find_key("KEYMAP", field);
+        if (key < 0) {
+            errno = 0;
+            return -1;
+        }
+        entry.key = key;
+        while ((field = strtok_r(NULL, SEP, &save)) != NULL) {
+            if (entry.nmods == KEYMAP_MAX_MODS) {
+                log_message(-1, "KEYMAP: %s:%d: too many modifier keys", filename, lineno);
+                errno = 0;
+                return -1;
+            }
+            if ((key = uinput_find_key("KEYMAP", field)) < 0) {
+                errno = 0;
+                return -1;
+            }
+            entry.mods[entry.nmods++] = key;
+        }
+        if (keymap_add(map, &entry) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * Find a section of XKB keymap.
+ *
+ * @param text  keymap text.
+ * @param name  section keyword.
+ * @param pend  pointer to buffer for section end (closing brace).
+ * @return      section start (after opening brace), or `NULL` if not found.
+ */
+static char *keymap_xkb_section(char *text, const char *name, char **pend) {
+    char *sp = strstr(text, name);
+    if (sp == NULL || (sp = strchr(sp, '{')) == NULL)
+        return NULL;
+    int depth = 1;
+    char *ep = ++sp;
+    for (; *ep != '\0'; ep++) {
+        if (*ep == '{')
+            depth++;
+        else if (*ep == '}' && --depth == 0)
+            break;
+    }
+    *pend = ep;
+    return sp;
+}
+
+/**
+ * Parse an XKB key name (`<NAME>`).
+ *
+ * @param ps    pointer to string pointer at opening bracket; advanced past the name.
+ * @param name  buffer for the name.
+ * @return      zero on success, or `-1` on error.
+ */
+static int keymap_xkb_keyname(char **ps, char *name) {
+    char *sp = *ps + 1, *ep = strchr(sp, '>');
+    if (ep == NULL || ep == sp || (size_t)(ep - sp) >= sizeof(((struct keymap_keyname *)0)->name))
+        return -1;
+    memcpy(name, sp, ep - sp);
+    name[ep - sp] = '\0';
+    *ps = ep + 1;
+    return 0;
+}
+
+/**
+ * Skip whitespace.
+ *
+ * @param sp  string.
+ * @return    first non-space character.
+ */
+static char *keymap_skip(char *sp) {
+    while (isspace((unsigned char)*sp))
+        sp++;
+    return sp;
+}
+
+/**
+ * Find XKB key code by key name.
+ *
+ * @param names   key names.
+ * @param nnames  number of key names.
+ * @param name    name to look for.
+ * @return        key code, or `-1` if not found.
+ */
+static int keymap_xkb_code(const struct keymap_keyname *names, size_t nnames, const char *name) {
+    for (size_t i = 0; i < nnames; i++)
+        if (strcmp(names[i].name, name) == 0)
+            return names[i].code;
+    return -1;
+}
+
+/**
+ * Parse an XKB keymap.
+ *
+ * @param map       keymap.
+ * @param filename  file name (for messages).
+ * @param text      file contents (modified).
+ * @return          zero on success, or `-1` on error.
+ */
+static int keymap_parse_xkb(struct keymap *map, const char *filename, char *text) {
+    // Blank out comments
+    for (char *sp = strstr(text, "//"); sp != NULL; sp = strstr(sp, "//"))
+        while (*sp != '\0' && *sp != '\n')
+            *sp++ = ' ';
+
+    char *sect_end = NULL, *syms_end = NULL;
+    char *sect = keymap_xkb_section(text, "xkb_keycodes", &sect_end);
+    char *syms = keymap_xkb_section(text, "xkb_symbols", &syms_end);
+    if (sect == NULL || syms == NULL) {
+        log_message(-1, "KEYMAP: %s: missing key codes or symbols", filename);
+        errno = 0;
+        return -1;
+    }
+
+    // Key codes: "<NAME> = code;" and "alias <NAME> = <NAME>;"
+    struct keymap_keyname *names = NULL;
+    size_t nnames = 0, size = 0;
+    for (char *sp = strchr(sect, '<'); sp != NULL && sp < sect_end; sp = strchr(sp, '<')) {
+        struct keymap_keyname kn;
+        char target[sizeof(kn.name)];
+        if (keymap_xkb_keyname(&sp, kn.name) < 0)
+            break;
+        sp = keymap_skip(sp);
+        if (*sp != '=')
+            continue;
+        sp = keymap_skip(sp + 1);
+        if (*sp == '<') {
+            if (keymap_xkb_keyname(&sp, target) < 0)
+                break;
+            kn.code = keymap_xkb_code(names, nnames, target);
+        } else
+            kn.code = (int)strtol(sp, &sp, 10);
+        if (kn.code <= KEYMAP_XKB_OFFSET)
+            continue;
+        if (nnames == size) {
+            size = size == 0 ? 256 : size*2;
+            struct keymap_keyname *tmp = realloc(names, size*sizeof(*names));
+            if (tmp == NULL) {
+                free(names);
+                return -1;
+            }
+            names = tmp;
+        }
+        names[nnames++] = kn;
+    }
+
+    // Key symbols: "key <NAME> { ... symbols[Group1]= [ sym, ... ] ... };"
+    int ret = 0;
+    for (char *sp = strstr(syms, "key <"); sp != NULL && sp < syms_end; sp = strstr(sp, "key <")) {
+        char name[sizeof(names[0].name)];
+        sp += 4;
+        if (keymap_xkb_keyname(&sp, name) < 0)
+            break;
+        char *body = strchr(sp, '{'), *body_end = body != NULL ? strchr(body, '}') : NULL;
+        if (body_end == NULL)
+            break;
+        sp = body_end;
+        int code = keymap_xkb_code(names, nnames, name);
+        if (code < 0)
+            continue;
+        *body_end = '\0';
+        char *list = strstr(body, "symbols[Group1]");
+        if (list != NULL)
+            list = strchr(list + strlen("symbols[Group1]"), '[');
+        else if (strstr(body, "symbols[") == NULL)
+            list = strchr(body, '[');
+        char *list_end = list != NULL ? strchr(list, ']') : NULL;
+        if (list_end != NULL) {
+            *list_end = '\0';
+            char *save = NULL;
+            int level = 0;
+            for (char *sym = strtok_r(list + 1, ", \t\r\n", &save);
+                 sym != NULL && level < KEYMAP_MAX_LEVELS;
+                 sym = strtok_r(NULL, ", \t\r\n", &save), level++) {
+                long value = keymap_keysym(sym);
+                if (value < 0)
+                    continue;
+                struct keymap_entry entry;
+                memset(&entry, 0, sizeof(entry));
+                entry.codepoint = value;
+                entry.key = code - KEYMAP_XKB_OFFSET;
+                for (int i = 0; i < 2 && KEYMAP_LEVEL_MODS[level][i] != 0; i++)
+                    entry.mods[entry.nmods++] = KEYMAP_LEVEL_MODS[level][i];
+                if ((ret = keymap_add(map, &entry)) < 0)
+                    break;
+            }
+        }
+        *body_end = '}';
+        if (ret < 0)
+            break;
+    }
+    free(names);
+    return ret;
+}
+
+/**
+ * Compare keymap entries by code point (for `qsort` and `bsearch`).
+ *
+ * @param a  first entry.
+ * @param b  second entry.
+ * @return   comparison result.
+ */
+static int keymap_compare(const void *a, const void *b) {
+    unsigned ca = ((const struct keymap_entry *)a)->codepoint;
+    unsigned cb = ((const struct keymap_entry *)b)->codepoint;
+    return ca < cb ? -1 : ca > cb ? 1 : 0;
+}
+
+/**
+ * Read a whole file.
+ *
+ * @param filename  file name.
+ * @return          file contents (to be freed), or `NULL` on error.
+ */
+static char *keymap_read(const char *filename) {
+    FILE *file = fopen(filename, "re");
+    if (file == NULL)
+        return NULL;
+    char *text = NULL;
+    size_t len = 0, size = 0;
+    for (;;) {
+        if (size - len < 4096) {
+            size = size == 0 ? 16384 : size*2;
+            char *tmp = realloc(text, size);
+            if (tmp == NULL)
+                break;
+            text = tmp;
+        }
+        size_t nread = fread(text + len, 1, size - len - 1, file);
+        len += nread;
+        if (nread == 0) {
+            if (ferror(file))
+                break;
+            fclose(file);
+            text[len] = '\0';
+            return text;
+        }
+    }
+    int err = errno;
+    fclose(file);
+    free(text);
+    errno = err;
+    return NULL;
+}
+
+/**
+ * Load a keymap.
+ *
+ * Keymaps are cached, so loading the same file again is cheap.
+ * Syntax errors are reported as messages, with `errno` set to zero.
+ *
+ * @param filename  keymap file name.
+ * @return          keymap, or `NULL` on error (with `errno` set).
+ */
+const struct keymap *keymap_load(const char *filename) {
+    for (struct keymap *map = KEYMAP_LOADED; map != NULL; map = map->next)
+        if (strcmp(map->filename, filename) == 0)
+            return map;
+    char *text = keymap_read(filename);
+    if (text == NULL)
+        return NULL;
+    struct keymap *map = calloc(1, sizeof(*map));
+    if (map == NULL || (map->filename = strdup(filename)) == NULL) {
+        free(map);
+        free(text);
+        return NULL;
+    }
+    int ret;
+    if (strstr(text, "xkb_symbols") != NULL)
+        ret = keymap_parse_xkb(map, filename, text);
+    else
+        ret = keymap_parse_table(map, filename, text);
+    free(text);
+    if (ret < 0) {
+        int err = errno;
+        free(map->entries);
+        free(map->filename);
+        free(map);
+        errno = err;
+        return NULL;
+    }
+    qsort(map->entries, map->count, sizeof(map->entries[0]), keymap_compare);
+    log_message(2, "KEYMAP: loaded %zu character(s) from %s", map->count, filename);
+    map->next = KEYMAP_LOADED;
+    KEYMAP_LOADED = map;
+    return map;
+}
+
+/**
+ * Find key combination for a character.
+ *
+ * @param map        keymap.
+ * @param codepoint  Unicode code point.
+ * @return           keymap entry, or `NULL` if not found.
+ */
+const struct keymap_entry *keymap_find(const struct keymap *map, unsigned codepoint) {
+    struct keymap_entry key;
+    key.codepoint = codepoint;
+    return bsearch(&key, map->entries, map->count, sizeof(map->entries[0]), keymap_compare);
+}
+
+/**
+ * Compile a string to a sequence of key combinations.
+ *
+ * @param map    keymap.
+ * @param text   UTF-8 string.
+ * @param pseq   pointer to buffer for the sequence (to be freed).
+ * @param plen   pointer to buffer for the sequence length.
+ * @param pbad   pointer to buffer for the character not found in keymap,
+ *               `-1` if the string is not valid UTF-8, or `-2` if out
+ *               of memory.
+ * @return       zero on success, or `-1` on error.
+ */
+int keymap_compile(const struct keymap *map, const char *text,
+                   const struct keymap_entry ***pseq, size_t *plen, long *pbad) {
+    const struct keymap_entry **seq = malloc((strlen(text) + 1)*sizeof(*seq));
+    if (seq == NULL) {
+        *pbad = -2;
+        return -1;
+    }
+    size_t len = 0;
+    while (*text != '\0') {
+        long value = keymap_utf8(&text);
+        if (value < 0 || (seq[len] = keymap_find(map, (unsigned)value)) == NULL) {
+            free(seq);
+            *pbad = value;
+            return -1;
+        }
+        len++;
+    }
+    *pseq = seq;
+    *plen = len;
+    return 0;
+}
+
+/**
+ * Press or release modifier keys of a keymap entry, as one frame.
+ *
+ * @param entry  keymap entry, or `NULL` for no modifiers.
+ * @param value  `1` to press, or `0` to release.
+ * @return       zero on success, or `-1` on error.
+ */
+static int keymap_mods(const struct keymap_entry *entry, int value) {
+    if (entry == NULL || entry->nmods == 0)
+        return 0;
+    for (int i = 0; i < entry->nmods; i++)
+        if (uinput_keyop(entry->mods[value ? i : entry->nmods - 1 - i], value, 0) < 0)
+            return -1;
+    return uinput_sync();
+}
+
+/**
+ * Check whether two keymap entries have the same modifier keys.
+ *
+ * @param a  first entry, or `NULL`.
+ * @param b  second entry.
+ * @return   non-zero if modifiers are the same.
+ */
+static int keymap_same_mods(const struct keymap_entry *a, const struct keymap_entry *b) {
+    if (a == NULL)
+        return b->nmods == 0;
+    return a->nmods == b->nmods && memcmp(a->mods, b->mods, a->nmods*sizeof(a->mods[0])) == 0;
+}
+
+/**
+ * Type a compiled sequence.
+ *
+ * Characters are typed at fixed deadlines. Frames of each character
+ * (modifier changes, key press, key release) are written at once.
+ * Modifier keys are held while consecutive characters need them.
+ *
+ * @param seq   sequence of key combinations.
+ * @param len   sequence length.
+ * @param rate  characters per second, or zero for no delays.
+ * @return      zero on success, or `-1` on error.
+ */
+int keymap_type(const struct keymap_entry *const *seq, size_t len, double rate) {
+    if (uinput_open() < 0)
+        return -1;
+    const struct keymap_entry *held = NULL;
+    double start = timing_now();
+    int ret = 0;
+    for (size_t i = 0; i < len && ret == 0; i++) {
+        if (rate > 0 && i > 0 && track_wait_until(start + i/rate) < 0) {
+            ret = -1;
+            break;
+        }
+        const struct keymap_entry *entry = seq[i];
+        uinput_batch_begin(0);
+        if (!keymap_same_mods(held, entry)) {
+            ret = keymap_mods(held, 0);
+            if (ret == 0)
+                ret = keymap_mods(entry, 1);
+            held = entry;
+        }
+        if (ret == 0)
+            ret = uinput_keyop(entry->key, 1, 1);
+        if (ret == 0)
+            ret = uinput_keyop(entry->key, 0, 1);
+        if (uinput_batch_end(0) < 0)
+            ret = -1;
+    }
+    if (keymap_mods(held, 0) < 0)
+        ret = -1;
+    return ret;
+}
@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Keyboard layout declarations
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#define KEYMAP_MAX_MODS 4  ///< Maximum number of modifier keys for a character.
+
+/**
+ * Key combination for a character.
+ */
+struct keymap_entry {
+    unsigned       codepoint;              ///< Unicode code point.
+    unsigned short key;                    ///< Key code.
+    unsigned short nmods;                  ///< Number of modifier keys.
+    unsigned short mods[KEYMAP_MAX_MODS];  ///< Modifier key codes.
+};
+
+struct keymap;
+
+const struct keymap *keymap_load(const char *filename);
+const struct keymap_entry *keymap_find(const struct keymap *map, unsigned codepoint);
+int keymap_compile(const struct keymap *map, const char *text,
+                   const struct keymap_entry ***pseq, size_t *plen, long *pbad);
+int keymap_type(const struct keymap_entry *const *seq, size_t len, double rate);
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Asynchronous log buffer
+ *
+ * With option `--async-log` messages are formatted into a ring buffer
+ * and written to standard error by a background thread, so that
+ * tracing barely disturbs script timing. Messages are timestamped with
+ * real monotonic time (since the buffer was started) when they are
+ * pushed, not when they are written.
+ *
+ * There's only one producer (all tracks run on the main thread) and
+ * one consumer (the writer thread), so the ring needs no locking.
+ * When the ring is full, optional messages are dropped and counted,
+ * while errors and mandatory messages wait for free space.
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "udotool.h"
+#include "logring.h"
+#include "timing.h"
+
+#define LOGRING_SIZE     1024  ///< Number of messages in the ring (power of 2).
+#define LOGRING_MSG_SIZE 240   ///< Maximum message length, including terminator.
+#define LOGRING_POLL     0.005 ///< Writer thread poll interval, in seconds.
+
+/**
+ * Buffered message.
+ */
+struct logring_msg {
+    double time;                    ///< Real time since start, in seconds.
+    int    level;                   ///< Message level.
+    char   text[LOGRING_MSG_SIZE];  ///< Formatted message.
+};
+
+/**
+ * Message ring, or `NULL` if not started.
+ */
+static struct logring_msg *LOGRING = NULL;
+
+/**
+ * Ring positions: next message to write (producer), and next message
+ * to print (consumer).
+ */
+static atomic_size_t LOGRING_HEAD = 0;
+static atomic_size_t LOGRING_TAIL = 0;
+
+/**
+ * Writer thread stop request.
+ */
+static atomic_int LOGRING_STOP = 0;
+
+/**
+ * Number of dropped messages.
+ */
+static unsigned long LOGRING_DROPPED = 0;
+
+/**
+ * Real time the ring was started at.
+ */
+static double LOGRING_START = 0;
+
+/**
+ * Writer thread.
+ */
+static pthread_t LOGRING_THREAD;
+
+/**
+ * Sleep for a short time.
+ *
+ * @param delay  delay, in seconds of real time.
+ */
+static void logring_pause(double delay) {
+    struct timespec ts;
+    timing_to_timespec(delay, &ts);
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * Print all buffered messages.
+ *
+ * Messages are collected into a local buffer to write them with as few
+ * system calls as possible.
+ */
+static void logring_drain(void) {
+    char buffer[8192];
+    size_t len = 0;
+    size_t tail = atomic_load_explicit(&LOGRING_TAIL, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&LOGRING_HEAD, memory_order_acquire);
+    for (; tail != head; tail++) {
+        const struct logring_msg *msg = &LOGRING[tail & (LOGRING_SIZE - 1)];
+        if (len + LOGRING_MSG_SIZE + 64 > sizeof(buffer)) {
+            fwrite(buffer, 1, len, stderr);
+            len = 0;
+        }
+        int ret;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-truncation"
+        // Truncation cannot happen, since we reserve space for prefix
+        if (msg->level > 0)
+            ret = snprintf(&buffer[len], sizeof(buffer) - len, "[%d] [+%.6f] %s\n", msg->level, msg->time, msg->text);
+        else if (msg->level < 0)
+            ret = snprintf(&buffer[len], sizeof(buffer) - len, "[ERROR] %s\n", msg->text);
+        else
+            ret = snprintf(&buffer[len], sizeof(buffer) - len, "%s\n", msg->text);
+#pragma GCC diagnostic pop
+        if (ret > 0)
+            len += (size_t)ret;
+    }
+    if (len > 0)
+        fwrite(buffer, 1, len, stderr);
+    atomic_store_explicit(&LOGRING_TAIL, tail, memory_order_release);
+}
+
+/**
+ * Writer thread procedure.
+ *
+ * @param data  unused.
+ * @return      always `NULL`.
+ */
+static void *logring_writer(void *data) {
+    (void)data;
+    for (;;) {
+        int stop = atomic_load(&LOGRING_STOP);
+        logring_drain();
+        if (stop)
+            break;
+        logring_pause(LOGRING_POLL);
+    }
+    return NULL;
+}
+
+/**
+ * Start asynchronous logging.
+ *
+ * Buffer is flushed and writer thread is stopped at exit.
+ *
+ * @return  zero on success, or `-1` on error.
+ */
+int logring_start(void) {
+    if (LOGRING != NULL)
+        return 0;
+    struct logring_msg *ring = malloc(LOGRING_SIZE*sizeof(*ring));
+    if (ring == NULL) {
+        log_message(-1, "log buffer allocation error: %s", strerror(errno));
+        return -1;
+    }
+    LOGRING_START = timing_real_now();
+    LOGRING = ring;
+    int err = pthread_create(&LOGRING_THREAD, NULL, logring_writer, NULL);
+    if (err != 0) {
+        LOGRING = NULL;
+        free(ring);
+        log_message(-1, "log writer thread error: %s", strerror(err));
+        return -1;
+    }
+    atexit(logring_stop);
+    return 0;
+}
+
+/**
+ * Stop asynchronous logging, printing all buffered messages.
+ */
+void logring_stop(void) {
+    if (LOGRING == NULL)
+        return;
+    atomic_store(&LOGRING_STOP, 1);
+    pthread_join(LOGRING_THREAD, NULL);
+    free(LOGRING);
+    LOGRING = NULL;
+    if (LOGRING_DROPPED > 0)
+        log_message(-1, "log buffer overflow: %lu messages dropped", LOGRING_DROPPED);
+}
+
+/**
+ * Push a message to the buffer.
+ *
+ * Error messages are not only pushed, but also waited for, so that
+ * they reach standard error before the program can exit or crash.
+ *
+ * @param level  message level.
+ * @param fmt    `printf`-like message format.
+ * @param args   message format arguments.
+ * @return       zero if the message was consumed (buffered or dropped),
+ *               or `-1` if asynchronous logging is not active.
+ */
+int logring_push(int level, const char *fmt, va_list args) {
+    if (LOGRING == NULL)
+        return -1;
+    size_t head = atomic_load_explicit(&LOGRING_HEAD, memory_order_relaxed);
+    while (head - atomic_load_explicit(&LOGRING_TAIL, memory_order_acquire) >= LOGRING_SIZE) {
+        if (level > 0) {
+            LOGRING_DROPPED++;
+            return 0;
+        }
+        logring_pause(LOGRING_POLL/10);
+    }
+    struct logring_msg *msg = &LOGRING[head & (LOGRING_SIZE - 1)];
+    msg->time  = timing_real_now() - LOGRING_START;
+    msg->level = level;
+    size_t len = 0;
+    if (level > 0 && CFG_VIRTUAL_TIME) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-truncation"
+        // Long messages are truncated by design
+        int ret = snprintf(msg->text, sizeof(msg->text), "[%.6f] ", timing_now());
+#pragma GCC diagnostic pop
+        if (ret > 0 && (size_t)ret < sizeof(msg->text))
+            len = (size_t)ret;
+    }
+    vsnprintf(&msg->text[len], sizeof(msg->text) - len, fmt, args);
+    atomic_store_explicit(&LOGRING_HEAD, head + 1, memory_order_release);
+    if (level < 0)
+        while (atomic_load_explicit(&LOGRING_TAIL, memory_order_acquire) != head + 1)
+            logring_pause(LOGRING_POLL/10);
+    return 0;
+}
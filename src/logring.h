@@ -0,0 +1,10 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Asynchronous log buffer declarations
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+int logring_start(void);
+void logring_stop(void);
+int logring_push(int level, const char *fmt, va_list args)
+    __attribute__ ((format (printf, 2, 0)));
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Motion interpolation
+ *
+ * A motion is a path from the current position through optional
+ * intermediate points to the target, followed during specified time.
+ * Frames are emitted at fixed rate on absolute deadlines, so waiting
+ * errors don't accumulate; if frames are late, the overdue ones are
+ * skipped. Relative motions emit differences between consecutive
+ * path points, and their fractional parts are carried to the end.
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#include <math.h>
+#include <string.h>
+
+#include "udotool.h"
+#include "motion.h"
+#include "uinput-func.h"
+#include "timing.h"
+#include "track.h"
+
+/**
+ * Motion curve names (see `MOTION_CURVE_*`).
+ */
+const char *const MOTION_CURVES[] = { "linear", "ease", "bezier", "spline", NULL };
+
+/**
+ * Round a value to nearest integer.
+ *
+ * @param value  value.
+ * @return       rounded value.
+ */
+static long motion_round(double value) {
+    return value < 0 ? (long)(value - 0.5) : (long)(value + 0.5);
+}
+
+/**
+ * Get distance between two path points.
+ *
+ * @param path  motion path.
+ * @param a     first point index.
+ * @param b     second point index.
+ * @return      distance.
+ */
+static double motion_distance(const struct motion_path *path, int a, int b) {
+    double sum = 0;
+    for (int k = 0; k < path->naxes; k++) {
+        double d = path->points[b][k] - path->points[a][k];
+        sum += d*d;
+    }
+    return sqrt(sum);
+}
+
+/**
+ * Evaluate a polyline path.
+ *
+ * Position along the path is proportional to the path length,
+ * so that motion speed is constant.
+ *
+ * @param path    motion path.
+ * @param length  cumulative lengths of path segments.
+ * @param s       path parameter (`0` to `1`).
+ * @param out     buffer for the point.
+ */
+static void motion_polyline(const struct motion_path *path, const double *length, double s, double *out) {
+    int last = path->npoints - 1;
+    double target = s*length[last];
+    int seg = 1;
+    while (seg < last && length[seg] < target)
+        seg++;
+    double seglen = length[seg] - length[seg - 1];
+    double t = seglen > 0 ? (target - length[seg - 1])/seglen : 1;
+    for (int k = 0; k < path->naxes; k++)
+        out[k] = path->points[seg - 1][k] + t*(path->points[seg][k] - path->points[seg - 1][k]);
+}
+
+/**
+ * Evaluate a Bezier path.
+ *
+ * @param path  motion path.
+ * @param s     path parameter (`0` to `1`).
+ * @param out   buffer for the point.
+ */
+static void motion_bezier(const struct motion_path *path, double s, double *out) {
+    double tmp[MOTION_MAX_POINTS][MOTION_MAX_AXES];
+    memcpy(tmp, path->points, sizeof(tmp));
+    for (int n = path->npoints - 1; n > 0; n--)
+        for (int i = 0; i < n; i++)
+            for (int k = 0; k < path->naxes; k++)
+                tmp[i][k] += s*(tmp[i + 1][k] - tmp[i][k]);
+    for (int k = 0; k < path->naxes; k++)
+        out[k] = tmp[0][k];
+}
+
+/**
+ * Evaluate a Catmull-Rom spline path.
+ *
+ * Each segment between consecutive points takes equal time.
+ *
+ * @param path  motion path.
+ * @param s     path parameter (`0` to `1`).
+ * @param out   buffer for the point.
+ */
+static void motion_spline(const struct motion_path *path, double s, double *out) {
+    int nseg = path->npoints - 1;
+    int seg = (int)(s*nseg);
+    if (seg >= nseg)
+        seg = nseg - 1;
+    double t = s*nseg - seg, t2 = t*t, t3 = t2*t;
+    const double *p0 = path->points[seg > 0 ? seg - 1 : seg];
+    const double *p1 = path->points[seg];
+    const double *p2 = path->points[seg + 1];
+    const double *p3 = path->points[seg + 2 <= nseg ? seg + 2 : seg + 1];
+    for (int k = 0; k < path->naxes; k++)
+        out[k] = 0.5*(2*p1[k] + (p2[k] - p0[k])*t +
+                      (2*p0[k] - 5*p1[k] + 4*p2[k] - p3[k])*t2 +
+                      (3*p1[k] - p0[k] - 3*p2[k] + p3[k])*t3);
+}
+
+/**
+ * Emit one motion frame.
+ *
+ * @param path     motion path.
+ * @param point    current point.
+ * @param emitted  values emitted so far (updated).
+ * @param last     non-zero for the last frame.
+ * @return         zero on success, or `-1` on error.
+ */
+static int motion_frame(const struct motion_path *path, const double *point, long *emitted, int last) {
+    int changed = 0;
+    for (int k = 0; k < path->naxes; k++) {
+        long value = motion_round(point[k]);
+        if (path->abs_flag) {
+            // Curves may overshoot the axis range
+            int min, max;
+            uinput_abs_range(path->axes[k], &min, &max);
+            value = value < min ? min : value > max ? max : value;
+            if (value == emitted[k])
+                continue;
+            if (uinput_absop_raw(path->axes[k], (int)value, 0) < 0)
+                return -1;
+        } else if (last) {
+            // Last frame also carries fractional part of the total
+            if (uinput_relop(path->axes[k], point[k] - emitted[k], 0) < 0)
+                return -1;
+        } else {
+            if (value == emitted[k])
+                continue;
+            if (uinput_relop(path->axes[k], value - emitted[k], 0) < 0)
+                return -1;
+        }
+        emitted[k] = value;
+        changed = 1;
+    }
+    return changed || last ? uinput_sync() : 0;
+}
+
+/**
+ * Run a motion.
+ *
+ * @param path  motion path; for absolute axes its starting point is set here.
+ * @return      zero on success, or `-1` on error.
+ */
+int motion_run(struct motion_path *path) {
+    if (uinput_open() < 0)
+        return -1;
+    long emitted[MOTION_MAX_AXES];
+    for (int k = 0; k < path->naxes; k++) {
+        if (path->abs_flag)
+            path->points[0][k] = uinput_abs_position(path->axes[k]);
+        emitted[k] = motion_round(path->points[0][k]);
+    }
+    double length[MOTION_MAX_POINTS];
+    length[0] = 0;
+    for (int i = 1; i < path->npoints; i++)
+        length[i] = length[i - 1] + motion_distance(path, i - 1, i);
+
+    long nsteps = (long)(path->duration*path->rate);
+    if (nsteps < 1)
+        nsteps = 1;
+    double start = timing_now(), interval = path->duration/nsteps;
+    double point[MOTION_MAX_AXES];
+    for (long n = 1; n <= nsteps; n++) {
+        if (track_wait_until(start + n*interval) < 0)
+            return -1;
+        if (interval > 0) {
+            // Skip frames that are overdue
+            long due = (long)((timing_now() - start)/interval);
+            if (due > n)
+                n = due < nsteps ? due : nsteps;
+        }
+        double s = (double)n/nsteps;
+        switch (n == nsteps ? -1 : path->curve) {
+        case MOTION_CURVE_EASE:
+            s = s*s*(3 - 2*s);
+            // fallthrough
+        case MOTION_CURVE_LINEAR:
+            motion_polyline(path, length, s, point);
+            break;
+        case MOTION_CURVE_BEZIER:
+            motion_bezier(path, s, point);
+            break;
+        case MOTION_CURVE_SPLINE:
+            motion_spline(path, s, point);
+            break;
+        default:
+            // Last frame lands exactly on the target
+            memcpy(point, path->points[path->npoints - 1], sizeof(point));
+            break;
+        }
+        if (motion_frame(path, point, emitted, n == nsteps) < 0)
+            return -1;
+    }
+    return 0;
+}
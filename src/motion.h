@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Motion interpolation declarations
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#define MOTION_MAX_AXES    3  ///< Maximum number of axes in a motion.
+#define MOTION_MAX_VIA    16  ///< Maximum number of intermediate points.
+#define MOTION_MAX_POINTS (MOTION_MAX_VIA + 2)  ///< Maximum number of path points.
+
+/**
+ * Motion curves.
+ */
+enum {
+    MOTION_CURVE_LINEAR = 0,  ///< Straight segments, constant speed.
+    MOTION_CURVE_EASE,        ///< Straight segments, smooth start and stop.
+    MOTION_CURVE_BEZIER,      ///< Bezier curve, intermediate points are control points.
+    MOTION_CURVE_SPLINE,      ///< Catmull-Rom spline through intermediate points.
+};
+
+/**
+ * Motion description.
+ *
+ * For relative axes points are offsets from the starting point,
+ * in axis units. For absolute axes points are positions, in device
+ * units; the starting point is filled in by `motion_run()`.
+ */
+struct motion_path {
+    int    abs_flag;  ///< Non-zero for absolute axes.
+    int    naxes;     ///< Number of axes.
+    int    axes[MOTION_MAX_AXES];  ///< Axis codes.
+    int    npoints;   ///< Number of points, including start and end.
+    double points[MOTION_MAX_POINTS][MOTION_MAX_AXES];  ///< Path points.
+    int    curve;     ///< Motion curve.
+    double duration;  ///< Motion duration, in seconds.
+    double rate;      ///< Frame rate, in frames per second.
+};
+
+extern const char *const MOTION_CURVES[];
+
+int motion_run(struct motion_path *path);
@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Script profiler
+ *
+ * With option `--profile-script` every command executed by scripts is
+ * reported here (from execution trace callback). Statistics are
+ * collected per source line and per command name: number of calls,
+ * inclusive time (until command completes), and exclusive time
+ * (excluding nested commands).
+ *
+ * Execution trace only reports command starts. A command is considered
+ * complete when another command starts at the same or lower script
+ * nesting depth. Each interpreter (main script and each track) has its
+ * own stack of active commands. All times are wall clock times, so
+ * times of concurrent tracks overlap.
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jim.h>
+
+#include "udotool.h"
+#include "profile.h"
+#include "timing.h"
+
+#define PROFILE_INIT_SIZE 256  ///< Initial hash table size (power of 2).
+
+/**
+ * Statistics for a source line or command name.
+ */
+struct profile_entry {
+    char         *name;    ///< Entry name.
+    unsigned long count;   ///< Number of calls.
+    double        incl;    ///< Inclusive time, in seconds.
+    double        excl;    ///< Exclusive time, in seconds.
+    unsigned      active;  ///< Number of active calls.
+};
+
+/**
+ * Hash table of entries (open addressing).
+ */
+struct profile_table {
+    struct profile_entry **slots;  ///< Slots.
+    size_t                 size;   ///< Number of slots.
+    size_t                 used;   ///< Number of used slots.
+};
+
+/**
+ * Active command.
+ */
+struct profile_frame {
+    struct profile_entry *line;   ///< Source line entry.
+    struct profile_entry *cmd;    ///< Command name entry.
+    int                   depth;  ///< Script nesting depth.
+    double                start;  ///< Start time.
+};
+
+/**
+ * Stack of active commands for an interpreter.
+ */
+struct profile_stack {
+    struct profile_frame *frames;  ///< Active commands.
+    size_t                num;     ///< Number of active commands.
+    size_t                cap;     ///< Allocated number of commands.
+    double                last;    ///< Time of last trace event.
+};
+
+/**
+ * Association key for per-interpreter stack.
+ */
+static const char PROFILE_ASSOC[] = "udotool:profile";
+
+/**
+ * Statistics per source line and per command name.
+ */
+static struct profile_table PROFILE_LINES;
+static struct profile_table PROFILE_CMDS;
+
+/**
+ * Calculate string hash.
+ *
+ * @param name  string.
+ * @return      hash value.
+ */
+static size_t profile_hash(const char *name) {
+    size_t hash = 5381;
+    for (const char *sp = name; *sp != '\0'; sp++)
+        hash = hash*33 + (unsigned char)*sp;
+    return hash;
+}
+
+/**
+ * Find entry by name, adding it if not found.
+ *
+ * @param table  hash table.
+ * @param name   entry name.
+ * @return       entry, or `NULL` on allocation error.
+ */
+static struct profile_entry *profile_find(struct profile_table *table, const char *name) {
+    if ((table->used + 1)*4 > table->size*3) {
+        size_t size = table->size == 0 ? PROFILE_INIT_SIZE : table->size*2;
+        struct profile_entry **slots = calloc(size, sizeof(*slots));
+        if (slots == NULL)
+            return NULL;
+        for (size_t i = 0; i < table->size; i++) {
+            struct profile_entry *entry = table->slots[i];
+            if (entry == NULL)
+                continue;
+            size_t idx = profile_hash(entry->name) & (size - 1);
+            while (slots[idx] != NULL)
+                idx = (idx + 1) & (size - 1);
+            slots[idx] = entry;
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->size  = size;
+    }
+    size_t idx = profile_hash(name) & (table->size - 1);
+    for (; table->slots[idx] != NULL; idx = (idx + 1) & (table->size - 1))
+        if (strcmp(table->slots[idx]->name, name) == 0)
+            return table->slots[idx];
+    struct profile_entry *entry = calloc(1, sizeof(*entry));
+    if (entry == NULL)
+        return NULL;
+    if ((entry->name = strdup(name)) == NULL) {
+        free(entry);
+        return NULL;
+    }
+    table->slots[idx] = entry;
+    table->used++;
+    return entry;
+}
+
+/**
+ * Complete the innermost active command.
+ *
+ * @param stack  command stack.
+ * @param now    current time.
+ */
+static void profile_pop(struct profile_stack *stack, double now) {
+    struct profile_frame *frame = &stack->frames[--stack->num];
+    // Recursive calls are accounted for only in the outermost one
+    if (--frame->line->active == 0)
+        frame->line->incl += now - frame->start;
+    if (--frame->cmd->active == 0)
+        frame->cmd->incl += now - frame->start;
+}
+
+/**
+ * Complete all active commands and free the stack.
+ *
+ * This is called when interpreter is deleted.
+ *
+ * @param interp  interpreter.
+ * @param data    command stack.
+ */
+static void profile_stack_free(Jim_Interp *interp, void *data) {
+    (void)interp;
+    struct profile_stack *stack = data;
+    double now = timing_real_now();
+    if (stack->num > 0) {
+        struct profile_frame *top = &stack->frames[stack->num - 1];
+        top->line->excl += now - stack->last;
+        top->cmd->excl  += now - stack->last;
+    }
+    while (stack->num > 0)
+        profile_pop(stack, now);
+    free(stack->frames);
+    free(stack);
+}
+
+/**
+ * Get command stack for an interpreter.
+ *
+ * @param interp  interpreter.
+ * @return        command stack, or `NULL` on allocation error.
+ */
+static struct profile_stack *profile_get_stack(Jim_Interp *interp) {
+    struct profile_stack *stack = Jim_GetAssocData(interp, PROFILE_ASSOC);
+    if (stack != NULL)
+        return stack;
+    if ((stack = calloc(1, sizeof(*stack))) == NULL)
+        return NULL;
+    Jim_SetAssocData(interp, PROFILE_ASSOC, profile_stack_free, stack);
+    return stack;
+}
+
+/**
+ * Account for a command start.
+ *
+ * @param interp  interpreter.
+ * @param fname   source file name.
+ * @param line    source line.
+ * @param cmd     command name.
+ */
+void profile_command(Jim_Interp *interp, const char *fname, long line, const char *cmd) {
+    double now = timing_real_now();
+    struct profile_stack *stack = profile_get_stack(interp);
+    if (stack == NULL)
+        return;
+    if (stack->num > 0) {
+        struct profile_frame *top = &stack->frames[stack->num - 1];
+        top->line->excl += now - stack->last;
+        top->cmd->excl  += now - stack->last;
+    }
+    int depth = interp->evalDepth;
+    while (stack->num > 0 && stack->frames[stack->num - 1].depth >= depth)
+        profile_pop(stack, now);
+    stack->last = now;
+
+    if (stack->num == stack->cap) {
+        size_t cap = stack->cap == 0 ? 16 : stack->cap*2;
+        struct profile_frame *frames = realloc(stack->frames, cap*sizeof(*frames));
+        if (frames == NULL)
+            return;
+        stack->frames = frames;
+        stack->cap    = cap;
+    }
+    char location[PATH_MAX + 32];
+    snprintf(location, sizeof(location), "%s:%ld", fname, line);
+    struct profile_frame *frame = &stack->frames[stack->num];
+    if ((frame->line = profile_find(&PROFILE_LINES, location)) == NULL ||
+        (frame->cmd = profile_find(&PROFILE_CMDS, cmd)) == NULL)
+        return;
+    frame->line->count++;
+    frame->line->active++;
+    frame->cmd->count++;
+    frame->cmd->active++;
+    frame->depth = depth;
+    frame->start = now;
+    stack->num++;
+}
+
+/**
+ * Compare entries by exclusive time, descending (for `qsort`).
+ *
+ * @param a  pointer to first entry pointer.
+ * @param b  pointer to second entry pointer.
+ * @return   comparison result.
+ */
+static int profile_compare(const void *a, const void *b) {
+    const struct profile_entry *ea = *(const struct profile_entry *const*)a;
+    const struct profile_entry *eb = *(const struct profile_entry *const*)b;
+    return ea->excl < eb->excl ? +1 : ea->excl > eb->excl ? -1 : 0;
+}
+
+/**
+ * Print top entries of a table.
+ *
+ * @param title   table title.
+ * @param column  name column title.
+ * @param table   hash table.
+ */
+static void profile_print(const char *title, const char *column, const struct profile_table *table) {
+    if (table->used == 0)
+        return;
+    struct profile_entry **entries = malloc(table->used*sizeof(*entries));
+    if (entries == NULL)
+        return;
+    size_t num = 0;
+    for (size_t i = 0; i < table->size; i++)
+        if (table->slots[i] != NULL)
+            entries[num++] = table->slots[i];
+    qsort(entries, num, sizeof(*entries), profile_compare);
+    if (num > (size_t)CFG_PROFILE)
+        num = (size_t)CFG_PROFILE;
+    log_message(0, "Top %zu %s by exclusive time:", num, title);
+    log_message(0, "  %10s %12s %12s  %s", "calls", "inclusive", "exclusive", column);
+    for (size_t i = 0; i < num; i++)
+        log_message(0, "  %10lu %12.6f %12.6f  %s",
+            entries[i]->count, entries[i]->incl, entries[i]->excl, entries[i]->name);
+    free(entries);
+}
+
+/**
+ * Print profiler report.
+ */
+void profile_report(void) {
+    profile_print("lines", "location", &PROFILE_LINES);
+    profile_print("commands", "command", &PROFILE_CMDS);
+}
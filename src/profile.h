@@ -0,0 +1,10 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Script profiler declarations
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+struct Jim_Interp;
+
+void profile_command(struct Jim_Interp *interp, const char *fname, long line, const char *cmd);
+void profile_report(void);
@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Timing functions
+ *
+ * All times here are in seconds of the script clock, which is the
+ * monotonic clock divided by time scale factor (see option
+ * `--time-scale`). So, with time scale `0.25` one second of script
+ * time takes 0.25 seconds of real time.
+ *
+ * In virtual time mode the clock is simulated: it starts at zero and
+ * advances only when somebody sleeps, and sleeping returns immediately.
+ *
+ * Startup phase timings (option `--timings`) are measured on the real
+ * monotonic clock, ignoring both time scale and virtual time.
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "udotool.h"
+#include "timing.h"
+#include "tracebin.h"
+
+/**
+ * Current virtual time, in seconds.
+ */
+static double TIMING_VIRTUAL_NOW = 0;
+
+/**
+ * Real time of process startup, in seconds.
+ */
+static double TIMING_STARTUP = 0;
+
+/**
+ * Startup phase statistics.
+ */
+static struct timing_phase {
+    const char *name;   ///< Phase description.
+    const char *unit;   ///< Name of counted operations.
+    double      total;  ///< Total duration, in seconds.
+    unsigned    count;  ///< Number of operations.
+    int         seen;   ///< Non-zero if phase was reached.
+} TIMING_PHASES[TIMING_PHASE_COUNT] = {
+    [TIMING_PHASE_INTERP]      = { "interpreter creation", "interpreters" },
+    [TIMING_PHASE_EXTENSIONS]  = { "extension init",       "interpreters" },
+    [TIMING_PHASE_BOOTSTRAP]   = { "bootstrap script",     "interpreters" },
+    [TIMING_PHASE_OPEN]        = { "device open",          "calls" },
+    [TIMING_PHASE_SETUP]       = { "device setup",         "ioctl calls" },
+    [TIMING_PHASE_CREATE]      = { "device creation",      "calls" },
+    [TIMING_PHASE_SETTLE]      = { "device settle",        "calls" },
+    [TIMING_PHASE_FIRST_EVENT] = { "first event",          NULL },
+};
+
+/**
+ * Convert time in seconds to `struct timespec`.
+ *
+ * @param value  time, in seconds (non-negative).
+ * @param ts     pointer to buffer for converted time.
+ */
+void timing_to_timespec(double value, struct timespec *ts) {
+    ts->tv_sec = (time_t)value;
+    ts->tv_nsec = (long)((value - ts->tv_sec)*NSEC_PER_SEC);
+    if (ts->tv_nsec >= (long)NSEC_PER_SEC)
+        ts->tv_nsec = (long)NSEC_PER_SEC - 1;
+}
+
+/**
+ * Get current time.
+ *
+ * @return  current script time, in seconds.
+ */
+double timing_now(void) {
+    if (CFG_VIRTUAL_TIME)
+        return TIMING_VIRTUAL_NOW;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec/NSEC_PER_SEC)/CFG_TIME_SCALE;
+}
+
+/**
+ * Sleep until specified time.
+ *
+ * If the deadline has already passed, this function returns immediately.
+ *
+ * @param deadline  script time to wake up at, in seconds.
+ * @return          zero on success, or `-1` on error (with `errno` set).
+ */
+int timing_sleep_until(double deadline) {
+    if (CFG_VIRTUAL_TIME) {
+        if (deadline > TIMING_VIRTUAL_NOW)
+            TIMING_VIRTUAL_NOW = deadline;
+        return 0;
+    }
+    if (deadline <= 0)
+        return 0;
+    struct timespec tval;
+    timing_to_timespec(deadline*CFG_TIME_SCALE, &tval);
+    int err;
+    while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tval, NULL)) != 0) {
+        if (err != EINTR) {
+            errno = err;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Sleep for specified time.
+ *
+ * @param delay  delay, in seconds of script time.
+ * @return       zero on success, or `-1` on error (with `errno` set).
+ */
+int timing_sleep(double delay) {
+    return timing_sleep_until(timing_now() + delay);
+}
+
+/**
+ * Get timestamp for an input event.
+ *
+ * In virtual time mode this is virtual time since the Epoch,
+ * otherwise it's current wall clock time.
+ *
+ * @param tv  pointer to buffer for timestamp.
+ */
+void timing_timestamp(struct timeval *tv) {
+    if (CFG_VIRTUAL_TIME) {
+        tv->tv_sec  = (time_t)TIMING_VIRTUAL_NOW;
+        tv->tv_usec = (suseconds_t)((TIMING_VIRTUAL_NOW - tv->tv_sec)*USEC_PER_SEC);
+        return;
+    }
+    gettimeofday(tv, NULL);
+}
+
+/**
+ * Get current real time.
+ *
+ * @return  monotonic clock time, in seconds.
+ */
+double timing_real_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/NSEC_PER_SEC;
+}
+
+/**
+ * Remember process startup time.
+ */
+void timing_startup(void) {
+    TIMING_STARTUP = timing_real_now();
+}
+
+/**
+ * Record duration of a startup phase.
+ *
+ * Durations and counts of repeated phases are summed. Phase end is
+ * also recorded to binary trace, if active.
+ *
+ * @param phase  phase code.
+ * @param start  real time when phase started, in seconds.
+ * @param count  number of operations performed.
+ */
+void timing_phase(int phase, double start, unsigned count) {
+    if (!CFG_TIMINGS && !tracebin_active())
+        return;
+    double duration = timing_real_now() - start;
+    tracebin_phase(phase, duration);
+    struct timing_phase *ph = &TIMING_PHASES[phase];
+    ph->total += duration;
+    ph->count += count;
+    ph->seen = 1;
+}
+
+/**
+ * Record time since startup for a phase, unless already recorded.
+ *
+ * @param phase  phase code.
+ */
+void timing_mark(int phase) {
+    if (TIMING_PHASES[phase].seen)
+        return;
+    timing_phase(phase, TIMING_STARTUP, 0);
+}
+
+/**
+ * Get startup phase description.
+ *
+ * @param phase  phase code.
+ * @return       phase description.
+ */
+const char *timing_phase_name(int phase) {
+    if (phase < 0 || phase >= TIMING_PHASE_COUNT)
+        return "unknown";
+    return TIMING_PHASES[phase].name;
+}
+
+/**
+ * Print startup phase timings.
+ */
+void timing_report(void) {
+    log_message(0, "Startup timings:");
+    for (const struct timing_phase *ph = TIMING_PHASES; ph < &TIMING_PHASES[TIMING_PHASE_COUNT]; ph++) {
+        if (!ph->seen)
+            log_message(0, "  %-22s not reached", ph->name);
+        else if (ph->unit != NULL)
+            log_message(0, "  %-22s %.6f s (%u %s)", ph->name, ph->total, ph->count, ph->unit);
+        else
+            log_message(0, "  %-22s %.6f s", ph->name, ph->total);
+    }
+}
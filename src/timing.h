@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Timing declarations
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+struct timespec;
+struct timeval;
+
+/**
+ * Startup phases (see option `--timings`).
+ */
+enum {
+    TIMING_PHASE_INTERP = 0,   ///< Interpreter creation.
+    TIMING_PHASE_EXTENSIONS,   ///< Jim extension initialization.
+    TIMING_PHASE_BOOTSTRAP,    ///< Bootstrap Tcl script.
+    TIMING_PHASE_OPEN,         ///< Opening UINPUT device.
+    TIMING_PHASE_SETUP,        ///< Device setup IOCTLs.
+    TIMING_PHASE_CREATE,       ///< Device creation.
+    TIMING_PHASE_SETTLE,       ///< Waiting for device to settle.
+    TIMING_PHASE_FIRST_EVENT,  ///< Time from startup to first event.
+    TIMING_PHASE_COUNT
+};
+
+void timing_to_timespec(double value, struct timespec *ts);
+double timing_now(void);
+int timing_sleep_until(double deadline);
+int timing_sleep(double delay);
+void timing_timestamp(struct timeval *tv);
+
+void timing_startup(void);
+double timing_real_now(void);
+void timing_phase(int phase, double start, unsigned count);
+void timing_mark(int phase);
+const char *timing_phase_name(int phase);
+void timing_report(void);
@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Binary trace
+ *
+ * With option `--trace-bin` every event written to the device, and
+ * every startup phase, is recorded to a file as a fixed-size binary
+ * record. Command `trace-dump` decodes such file.
+ *
+ * Trace file starts with a header (`struct tracebin_header`), followed
+ * by records (`struct tracebin_record`). All numbers are in host byte
+ * order; trace files are not meant to be portable between hosts.
+ *
+ * Timestamps are in nanoseconds of script time (see `timing.c`).
+ * Header contains wall clock time corresponding to script time zero.
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/uinput.h>
+
+#include "udotool.h"
+#include "uinput-func.h"
+#include "timing.h"
+#include "tracebin.h"
+
+#define TRACEBIN_VERSION     1           ///< Trace file format version.
+#define TRACEBIN_BUFFER_SIZE (64*1024)   ///< Trace file buffer size.
+#define TRACEBIN_FLAG_VIRTUAL 0x0001     ///< Trace recorded in virtual time.
+
+/**
+ * Trace file magic.
+ */
+static const char TRACEBIN_MAGIC[8] = "UDOTRACE";
+
+/**
+ * Trace file header.
+ */
+struct tracebin_header {
+    char     magic[8];     ///< Magic, `TRACEBIN_MAGIC`.
+    uint16_t version;      ///< Format version, `TRACEBIN_VERSION`.
+    uint16_t record_size;  ///< Size of a record.
+    uint32_t flags;        ///< Flags.
+    int64_t  epoch;        ///< Wall clock time at script time zero, in nanoseconds.
+};
+
+/**
+ * Record kinds.
+ */
+enum {
+    TRACEBIN_EVENT = 1,  ///< Input event.
+    TRACEBIN_PHASE,      ///< Startup phase end.
+};
+
+/**
+ * Trace record.
+ *
+ * For input events `type`, `code`, and `value` are event fields.
+ * For phase markers `code` is the phase code, and `value` is phase
+ * duration in microseconds.
+ */
+struct tracebin_record {
+    uint64_t time;      ///< Script time, in nanoseconds.
+    uint8_t  kind;      ///< Record kind.
+    uint8_t  reserved;  ///< Reserved, zero.
+    uint16_t type;      ///< Event type.
+    uint16_t code;      ///< Event code, or phase code.
+    uint16_t padding;   ///< Reserved, zero.
+    int32_t  value;     ///< Event value, or phase duration.
+    uint32_t line;      ///< Script line (zero if unknown).
+};
+
+/**
+ * Current script line.
+ */
+unsigned long TRACEBIN_LINE = 0;
+
+/**
+ * Trace file, or `NULL` if not tracing.
+ */
+static FILE *TRACEBIN_FILE = NULL;
+
+/**
+ * Open trace file.
+ *
+ * File is closed at exit.
+ *
+ * @param filename  trace file path.
+ * @return          zero on success, or `-1` on error.
+ */
+int tracebin_open(const char *filename) {
+    FILE *file = fopen(filename, "wbe");
+    if (file == NULL) {
+        log_message(-1, "trace file %s open error: %s", filename, strerror(errno));
+        return -1;
+    }
+    setvbuf(file, NULL, _IOFBF, TRACEBIN_BUFFER_SIZE);
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    struct tracebin_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACEBIN_MAGIC, sizeof(hdr.magic));
+    hdr.version     = TRACEBIN_VERSION;
+    hdr.record_size = sizeof(struct tracebin_record);
+    hdr.flags       = CFG_VIRTUAL_TIME ? TRACEBIN_FLAG_VIRTUAL : 0;
+    hdr.epoch       = (int64_t)wall.tv_sec*1000000000 + wall.tv_nsec - (int64_t)(timing_now()*NSEC_PER_SEC);
+    if (fwrite(&hdr, sizeof(hdr), 1, file) != 1) {
+        log_message(-1, "trace file %s write error: %s", filename, strerror(errno));
+        fclose(file);
+        return -1;
+    }
+    TRACEBIN_FILE = file;
+    atexit(tracebin_close);
+    return 0;
+}
+
+/**
+ * Close trace file, if open.
+ */
+void tracebin_close(void) {
+    if (TRACEBIN_FILE == NULL)
+        return;
+    if (fclose(TRACEBIN_FILE) != 0)
+        log_message(-1, "trace file write error: %s", strerror(errno));
+    TRACEBIN_FILE = NULL;
+}
+
+/**
+ * Check whether tracing is active.
+ *
+ * @return  non-zero if trace file is open.
+ */
+int tracebin_active(void) {
+    return TRACEBIN_FILE != NULL;
+}
+
+/**
+ * Write a trace record.
+ *
+ * @param kind   record kind.
+ * @param type   event type.
+ * @param code   event or phase code.
+ * @param value  event value or phase duration.
+ * @param line   script line.
+ */
+static void tracebin_write(int kind, int type, int code, int32_t value, unsigned long line) {
+    struct tracebin_record rec = {
+        .time  = (uint64_t)(timing_now()*NSEC_PER_SEC),
+        .kind  = kind,
+        .type  = type,
+        .code  = code,
+        .value = value,
+        .line  = (uint32_t)line,
+    };
+    if (fwrite(&rec, sizeof(rec), 1, TRACEBIN_FILE) != 1) {
+        log_message(-1, "trace file write error: %s", strerror(errno));
+        fclose(TRACEBIN_FILE);
+        TRACEBIN_FILE = NULL;
+    }
+}
+
+/**
+ * Record an input event.
+ *
+ * @param type   event type.
+ * @param code   event code.
+ * @param value  event value.
+ */
+void tracebin_event(int type, int code, int value) {
+    if (TRACEBIN_FILE != NULL)
+        tracebin_write(TRACEBIN_EVENT, type, code, value, TRACEBIN_LINE);
+}
+
+/**
+ * Record end of a startup phase.
+ *
+ * @param phase     phase code.
+ * @param duration  phase duration, in seconds of real time.
+ */
+void tracebin_phase(int phase, double duration) {
+    if (TRACEBIN_FILE != NULL)
+        tracebin_write(TRACEBIN_PHASE, 0, phase, (int32_t)(duration*USEC_PER_SEC), 0);
+}
+
+/**
+ * Find a name for an item value.
+ *
+ * @param ids    list of items.
+ * @param value  value to look for.
+ * @return       item name, or `NULL` if not found.
+ */
+static const char *tracebin_name(const struct udotool_obj_id ids[], int value) {
+    for (const struct udotool_obj_id *idptr = ids; idptr->name != NULL; idptr++)
+        if (idptr->value == value)
+            return idptr->name;
+    return NULL;
+}
+
+/**
+ * Print a decoded input event.
+ *
+ * @param out  output stream.
+ * @param rec  trace record.
+ */
+static void tracebin_print_event(FILE *out, const struct tracebin_record *rec) {
+    const char *type = NULL, *code = NULL;
+    switch (rec->type) {
+    case EV_SYN:
+        type = "SYN";
+        code = rec->code == SYN_REPORT ? "SYN_REPORT" : NULL;
+        break;
+    case EV_KEY:
+        type = "KEY";
+        code = tracebin_name(UINPUT_KEYS, rec->code);
+        break;
+    case EV_REL:
+        type = "REL";
+        code = tracebin_name(UINPUT_REL_AXES, rec->code);
+        for (int i = 0; code == NULL && UINPUT_HIRES_AXIS[i].lo_axis >= 0; i++)
+            if (rec->code == UINPUT_HIRES_AXIS[i].hi_axis)
+                code = rec->code == REL_WHEEL_HI_RES ? "REL_WHEEL_HI_RES" : "REL_HWHEEL_HI_RES";
+        break;
+    case EV_ABS:
+        type = "ABS";
+        code = tracebin_name(UINPUT_ABS_AXES, rec->code);
+        break;
+    }
+    if (type != NULL)
+        fprintf(out, " %s", type);
+    else
+        fprintf(out, " 0x%04X", (unsigned)rec->type);
+    if (code != NULL)
+        fprintf(out, " %s", code);
+    else
+        fprintf(out, " 0x%04X", (unsigned)rec->code);
+    fprintf(out, " %d\n", (int)rec->value);
+}
+
+/**
+ * Decode a trace file.
+ *
+ * @param filename  trace file path.
+ * @param out       output stream.
+ * @return          zero on success, or `-1` on error (with `errno` set,
+ *                  or zero for format errors).
+ */
+int tracebin_dump(const char *filename, FILE *out) {
+    FILE *file = fopen(filename, "rbe");
+    if (file == NULL)
+        return -1;
+    struct tracebin_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+        memcmp(hdr.magic, TRACEBIN_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != TRACEBIN_VERSION ||
+        hdr.record_size != sizeof(struct tracebin_record)) {
+        fclose(file);
+        errno = 0;
+        return -1;
+    }
+    fprintf(out, "# epoch %lld.%09lld%s\n",
+        (long long)(hdr.epoch/1000000000), (long long)(hdr.epoch%1000000000),
+        (hdr.flags & TRACEBIN_FLAG_VIRTUAL) != 0 ? " (virtual time)" : "");
+    struct tracebin_record rec;
+    while (fread(&rec, sizeof(rec), 1, file) == 1) {
+        fprintf(out, "%.6f", rec.time/NSEC_PER_SEC);
+        if (rec.line != 0)
+            fprintf(out, " line %u", (unsigned)rec.line);
+        switch (rec.kind) {
+        case TRACEBIN_EVENT:
+            tracebin_print_event(out, &rec);
+            break;
+        case TRACEBIN_PHASE:
+            fprintf(out, " PHASE %.6f %s\n", rec.value/USEC_PER_SEC, timing_phase_name(rec.code));
+            break;
+        default:
+            fprintf(out, " UNKNOWN %u\n", (unsigned)rec.kind);
+            break;
+        }
+    }
+    int ret = ferror(file) ? -1 : 0;
+    fclose(file);
+    return ret;
+}
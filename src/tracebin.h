@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Binary trace declarations
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+extern unsigned long TRACEBIN_LINE;
+
+int tracebin_open(const char *filename);
+void tracebin_close(void);
+void tracebin_event(int type, int code, int value);
+void tracebin_phase(int phase, double duration);
+int tracebin_active(void);
+int tracebin_dump(const char *filename, FILE *out);
@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Cooperative tracks
+ *
+ * Tracks are coroutines sharing one thread. Only one track runs at
+ * any moment, and it gives up control only when it waits for a
+ * deadline. At that point control passes to the track with the
+ * earliest deadline (the main program being one of the tracks).
+ *
+ * Each track may have its own wait function, which is used to wait
+ * for the deadline once that track is chosen to run.
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "udotool.h"
+#include "timing.h"
+#include "track.h"
+#include "uinput-func.h"
+
+#define TRACK_STACK_SIZE (1024*1024) ///< Track stack size, including guard page.
+
+/**
+ * Track states.
+ */
+enum {
+    TRACK_READY = 0,  ///< Running or waiting for a deadline.
+    TRACK_JOINING,    ///< Waiting for all other tracks to finish.
+    TRACK_DONE,       ///< Finished, waiting to be reaped.
+};
+
+/**
+ * Track descriptor.
+ */
+struct track {
+    struct track *next;      ///< Next track in list.
+    ucontext_t    ctx;       ///< Saved context.
+    double        deadline;  ///< Time to resume at.
+    int           state;     ///< Track state.
+    void         *stack;     ///< Stack memory, or `NULL` for main track.
+    track_entry_t entry;     ///< Entry point.
+    void         *data;      ///< Entry point data.
+    track_wait_t  wait;      ///< Wait function, or `NULL` for default.
+    void         *wait_data; ///< Wait function data.
+};
+
+/**
+ * Main track, also the head of track list.
+ */
+static struct track TRACK_MAIN = { .next = NULL, .state = TRACK_READY, .stack = NULL, .wait = NULL };
+/**
+ * Currently running track.
+ */
+static struct track *TRACK_CURRENT = &TRACK_MAIN;
+/**
+ * Number of spawned tracks not finished yet.
+ */
+static int TRACK_ACTIVE = 0;
+/**
+ * Non-zero if any of the spawned tracks failed.
+ */
+static int TRACK_FAILED = 0;
+
+/**
+ * Choose next track to run.
+ *
+ * Tracks with equal deadlines are chosen round-robin, starting
+ * after the current one.
+ *
+ * @return  track with the earliest deadline.
+ */
+static struct track *track_pick(void) {
+    struct track *cur = TRACK_CURRENT, *best = NULL, *t = cur;
+    do {
+        t = t->next != NULL ? t->next : &TRACK_MAIN;
+        if (t->state == TRACK_DONE || (t->state == TRACK_JOINING && TRACK_ACTIVE > 0))
+            continue;
+        if (best == NULL || t->deadline < best->deadline)
+            best = t;
+    } while (t != cur);
+    return best;
+}
+
+/**
+ * Switch to another track.
+ *
+ * Returns when some other track switches back to this one.
+ *
+ * @param next  track to switch to.
+ */
+static void track_switch(struct track *next) {
+    struct track *prev = TRACK_CURRENT;
+    TRACK_CURRENT = next;
+    swapcontext(&prev->ctx, &next->ctx);
+}
+
+/**
+ * Release resources of all finished tracks, except the current one.
+ */
+static void track_reap(void) {
+    struct track **pt = &TRACK_MAIN.next;
+    while (*pt != NULL) {
+        struct track *t = *pt;
+        if (t->state != TRACK_DONE || t == TRACK_CURRENT) {
+            pt = &t->next;
+            continue;
+        }
+        *pt = t->next;
+        munmap(t->stack, TRACK_STACK_SIZE);
+        free(t);
+    }
+}
+
+/**
+ * Track trampoline.
+ *
+ * Runs track entry point and passes control to the next track.
+ */
+static void track_start(void) {
+    struct track *t = TRACK_CURRENT;
+    if ((*t->entry)(t->data) < 0)
+        TRACK_FAILED = 1;
+    t->state = TRACK_DONE;
+    --TRACK_ACTIVE;
+    struct track *next = track_pick();
+    TRACK_CURRENT = next;
+    setcontext(&next->ctx);
+}
+
+/**
+ * Spawn a new track.
+ *
+ * The track becomes ready immediately, but it starts only when
+ * the current track waits.
+ *
+ * @param entry  track entry point.
+ * @param data   entry point data.
+ * @return       zero on success, or `-1` on error (with `errno` set).
+ */
+int track_spawn(track_entry_t entry, void *data) {
+    long page = sysconf(_SC_PAGESIZE);
+    struct track *t = calloc(1, sizeof(*t));
+    if (t == NULL)
+        return -1;
+    t->stack = mmap(NULL, TRACK_STACK_SIZE, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS|MAP_STACK, -1, 0);
+    if (t->stack == MAP_FAILED) {
+        free(t);
+        return -1;
+    }
+    // Guard page to catch stack overflow
+    if (mprotect(t->stack, page, PROT_NONE) < 0 || getcontext(&t->ctx) < 0) {
+        int err = errno;
+        munmap(t->stack, TRACK_STACK_SIZE);
+        free(t);
+        errno = err;
+        return -1;
+    }
+    t->ctx.uc_stack.ss_sp   = (char *)t->stack + page;
+    t->ctx.uc_stack.ss_size = TRACK_STACK_SIZE - page;
+    t->ctx.uc_link          = NULL;
+    makecontext(&t->ctx, track_start, 0);
+    t->deadline = timing_now();
+    t->state    = TRACK_READY;
+    t->entry    = entry;
+    t->data     = data;
+
+    struct track *last = &TRACK_MAIN;
+    while (last->next != NULL)
+        last = last->next;
+    last->next = t;
+    ++TRACK_ACTIVE;
+    log_message(2, "TRACK: spawned track %p", (void *)t);
+    return 0;
+}
+
+/**
+ * Set wait function for the current track.
+ *
+ * @param wait  wait function, or `NULL` to use plain sleep.
+ * @param data  wait function data.
+ */
+void track_set_wait(track_wait_t wait, void *data) {
+    TRACK_CURRENT->wait      = wait;
+    TRACK_CURRENT->wait_data = data;
+}
+
+/**
+ * Wait until specified time, letting other tracks run meanwhile.
+ *
+ * @param deadline  monotonic time to resume at, in seconds.
+ * @return          zero on success, or `-1` on error (with `errno` set).
+ */
+int track_wait_until(double deadline) {
+    struct track *cur = TRACK_CURRENT;
+    int ret;
+    do {
+        cur->deadline = deadline;
+        if (TRACK_MAIN.next != NULL) {
+            struct track *next = track_pick();
+            if (next != cur) {
+                // Don't let other tracks' events into our batch
+                struct udotool_batch batch;
+                if (uinput_batch_suspend(&batch) < 0)
+                    return -1;
+                track_switch(next);
+                uinput_batch_resume(&batch);
+            }
+            track_reap();
+        }
+        if (cur->wait != NULL)
+            ret = (*cur->wait)(deadline, cur->wait_data);
+        else
+            ret = timing_sleep_until(deadline);
+    } while (ret > 0);
+    return ret;
+}
+
+/**
+ * Wait until all spawned tracks finish.
+ *
+ * This must be called only from the main track.
+ *
+ * @return  zero on success, or `-1` if any of the tracks failed.
+ */
+int track_join(void) {
+    if (TRACK_CURRENT != &TRACK_MAIN)
+        return 0;
+    if (TRACK_ACTIVE > 0) {
+        log_message(2, "TRACK: waiting for %d track(s)", TRACK_ACTIVE);
+        TRACK_MAIN.state = TRACK_JOINING;
+        track_switch(track_pick());
+        TRACK_MAIN.state = TRACK_READY;
+    }
+    track_reap();
+    int ret = TRACK_FAILED ? -1 : 0;
+    TRACK_FAILED = 0;
+    return ret;
+}
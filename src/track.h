@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/**
+ * Cooperative track declarations
+ *
+ * Copyright (c) 2024 Alec Kojaev
+ */
+
+/**
+ * Track entry point.
+ *
+ * @param data  track data.
+ * @return      zero on success, or `-1` on error.
+ */
+typedef int (*track_entry_t)(void *data);
+
+/**
+ * Track wait function.
+ *
+ * The function may return before the deadline, if it has processed
+ * some other event meanwhile.
+ *
+ * @param deadline  monotonic time to wait until, in seconds.
+ * @param data      wait function data.
+ * @return          zero if deadline was reached, positive value if
+ *                  returned early, or `-1` on error (with `errno` set).
+ */
+typedef int (*track_wait_t)(double deadline, void *data);
+
+int track_spawn(track_entry_t entry, void *data);
+void track_set_wait(track_wait_t wait, void *data);
+int track_wait_until(double deadline);
+int track_join(void);
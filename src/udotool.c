@@ -5,6 +5,7 @@
  * Copyright (c) 2024 Alec Kojaev
  */
 #include <getopt.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,6 +15,10 @@
 #include "uinput-func.h"
 #include "config.h"
 #include "execute.h"
+#include "logring.h"
+#include "profile.h"
+#include "timing.h"
+#include "tracebin.h"
 
 /**
  * Full version string.
@@ -27,6 +32,20 @@
  */
 #define UINPUT_OPT_OFFSET 1000
 
+/**
+ * Codes for long options without a short equivalent.
+ */
+enum {
+    OPT_VIRTUAL_TIME = 0x100,  ///< Option `--virtual-time`.
+    OPT_TIME_SCALE,            ///< Option `--time-scale`.
+    OPT_LEAN_INIT,             ///< Option `--lean`.
+    OPT_TIMINGS,               ///< Option `--timings`.
+    OPT_ASYNC_LOG,             ///< Option `--async-log`.
+    OPT_TRACE_BIN,             ///< Option `--trace-bin`.
+    OPT_PROFILE,               ///< Option `--profile-script`.
+    OPT_NO_TIMESTAMPS,         ///< Option `--no-timestamps`.
+};
+
 #define QUOTE(v)  #v
 #define EQUOTE(v) QUOTE(v)
 
@@ -40,6 +59,22 @@ static const char USAGE_NOTICE[] = "Usage: %s [<option>...] <subcommand>...\n\n"
                                    "        Use file name '-' for standard input (default).\n"
                                    "    -n, --dry-run\n"
                                    "        Instead of executing provided commands, print what will be done.\n"
+                                   "    --virtual-time\n"
+                                   "        Use simulated clock: all delays complete instantly.\n"
+                                   "    --time-scale <factor>\n"
+                                   "        Multiply all script delays by specified factor (default is 1).\n"
+                                   "    --lean\n"
+                                   "        Initialize Jim extensions only when they're used.\n"
+                                   "    --timings\n"
+                                   "        Print durations of startup phases on exit.\n"
+                                   "    --async-log\n"
+                                   "        Buffer messages in memory and print them from a background thread.\n"
+                                   "    --trace-bin <file>\n"
+                                   "        Record emitted events to binary trace file.\n"
+                                   "    --profile-script[=<num>]\n"
+                                   "        Print <num> (default is " EQUOTE(DEFAULT_PROFILE_TOP) ") most expensive script lines and commands on exit.\n"
+                                   "    --no-timestamps\n"
+                                   "        Leave event timestamps zero (the kernel stamps events anyway).\n"
                                    "    --settle-time <time>\n"
                                    "        Use specified settle time (default is " EQUOTE(DEFAULT_SETTLE_TIME) ")\n"
                                    "    --dev <dev-path>\n"
@@ -48,6 +83,9 @@ static const char USAGE_NOTICE[] = "Usage: %s [<option>...] <subcommand>...\n\n"
                                    "        Use specified emulated device name.\n"
                                    "    --dev-id <vendor-id>:<product-id>[:<version>]\n"
                                    "        Use specified emulated device ID.\n"
+                                   "    --abs <axis>=<min>:<max>[:<res>[:<fuzz>[:<flat>]]][,...]\n"
+                                   "        Use specified range for absolute axis (default is 0:" EQUOTE(UINPUT_ABS_MAXVALUE) ").\n"
+                                   "        This option can be specified multiple times.\n"
                                    "    -v, --verbose\n"
                                    "        Increase command verbosity.\n"
                                    "        This option can be specified multiple times.\n"
@@ -66,16 +104,31 @@ static const struct option LONG_OPTION[] = {
     { "verbose",     no_argument,       NULL, 'v' },
     { "help",        no_argument,       NULL, 'h' },
     { "version",     no_argument,       NULL, 'V' },
+    { "virtual-time", no_argument,      NULL, OPT_VIRTUAL_TIME },
+    { "time-scale",  required_argument, NULL, OPT_TIME_SCALE },
+    { "lean",        no_argument,       NULL, OPT_LEAN_INIT },
+    { "timings",     no_argument,       NULL, OPT_TIMINGS },
+    { "async-log",   no_argument,       NULL, OPT_ASYNC_LOG },
+    { "trace-bin",   required_argument, NULL, OPT_TRACE_BIN },
+    { "profile-script", optional_argument, NULL, OPT_PROFILE },
+    { "no-timestamps", no_argument,     NULL, OPT_NO_TIMESTAMPS },
     { "settle-time", required_argument, NULL, UINPUT_OPT_OFFSET + UINPUT_OPT_SETTLE  },
     { "dev",         required_argument, NULL, UINPUT_OPT_OFFSET + UINPUT_OPT_DEVICE  },
     { "dev-name",    required_argument, NULL, UINPUT_OPT_OFFSET + UINPUT_OPT_DEVNAME },
     { "dev-id",      required_argument, NULL, UINPUT_OPT_OFFSET + UINPUT_OPT_DEVID   },
+    { "abs",         required_argument, NULL, UINPUT_OPT_OFFSET + UINPUT_OPT_ABS     },
     { NULL }
 };
 
 int         CFG_VERBOSITY = 0;        ///< Message verbosity level.
 int         CFG_DRY_RUN = 0;          ///< Dry run mode.
 const char *CFG_DRY_RUN_PREFIX = "";  ///< Message prefix for dry run, or an empty string.
+int         CFG_VIRTUAL_TIME = 0;     ///< Virtual time mode.
+double      CFG_TIME_SCALE = 1.0;     ///< Time scale factor.
+int         CFG_LEAN_INIT = 0;        ///< Lean interpreter initialization.
+int         CFG_TIMINGS = 0;          ///< Report startup phase timings.
+int         CFG_PROFILE = 0;          ///< Number of profiler report entries, or zero.
+int         CFG_NO_TIMESTAMPS = 0;    ///< Don't set event timestamps.
 
 /**
  * Print a message.
@@ -85,16 +138,25 @@ const char *CFG_DRY_RUN_PREFIX = "";  ///< Message prefix for dry run, or an emp
  * - `0` for mandatory messages.
  * - positive for verbosity-controlled optional messages.
  *
+ * In virtual time mode optional messages are prefixed with virtual time.
+ * With option `--async-log` messages are passed to the log buffer.
+ *
  * @param level  message level.
  * @param fmt    `printf`-like message format.
  * @param ...    message format arguments.
  */
-void log_message(int level, const char *fmt,...) {
+void (log_message)(int level, const char *fmt,...) {
     if (level > CFG_VERBOSITY)
         return;
     va_list args;
     va_start(args, fmt);
-    if (level > 0)
+    if (logring_push(level, fmt, args) == 0) {
+        va_end(args);
+        return;
+    }
+    if (level > 0 && CFG_VIRTUAL_TIME)
+        fprintf(stderr, "[%d] [%.6f] ", level, timing_now());
+    else if (level > 0)
         fprintf(stderr, "[%d] ", level);
     else if (level < 0)
         fprintf(stderr, "[ERROR] ");
@@ -117,13 +179,15 @@ static void load_preset(int opt, const char *envname) {
 }
 
 int main(int argc, char *const argv[]) {
-    int opt, optidx, has_file = 0;
-    const char *input_file = NULL;
+    int opt, optidx, has_file = 0, async_log = 0;
+    const char *input_file = NULL, *trace_file = NULL;
 
+    timing_startup();
     load_preset(UINPUT_OPT_SETTLE, "UDOTOOL_SETTLE_TIME");
     load_preset(UINPUT_OPT_DEVICE, "UDOTOOL_DEVICE_PATH");
     load_preset(UINPUT_OPT_DEVNAME, "UDOTOOL_DEVICE_NAME");
     load_preset(UINPUT_OPT_DEVID, "UDOTOOL_DEVICE_ID");
+    load_preset(UINPUT_OPT_ABS, "UDOTOOL_ABS_AXES");
     while ((opt = getopt_long(argc, argv, SHORT_OPTION, LONG_OPTION, &optidx)) != -1) {
         if (opt >= UINPUT_OPT_OFFSET) {
             if (uinput_set_option(opt - UINPUT_OPT_OFFSET, optarg) < 0)
@@ -143,6 +207,48 @@ int main(int argc, char *const argv[]) {
         case 'v':
             ++CFG_VERBOSITY;
             break;
+        case OPT_VIRTUAL_TIME:
+            CFG_VIRTUAL_TIME = 1;
+            break;
+        case OPT_LEAN_INIT:
+            CFG_LEAN_INIT = 1;
+            break;
+        case OPT_TIMINGS:
+            CFG_TIMINGS = 1;
+            break;
+        case OPT_ASYNC_LOG:
+            async_log = 1;
+            break;
+        case OPT_TRACE_BIN:
+            trace_file = optarg;
+            break;
+        case OPT_PROFILE:
+            CFG_PROFILE = DEFAULT_PROFILE_TOP;
+            if (optarg != NULL) {
+                char *ep = NULL;
+                long lval = strtol(optarg, &ep, 10);
+                if (ep == optarg || *ep != '\0' || lval < 1 || lval > INT_MAX) {
+                    log_message(-1, "error parsing profiler report size: %s", optarg);
+                    return EXIT_FAILURE;
+                }
+                CFG_PROFILE = (int)lval;
+            }
+            break;
+        case OPT_NO_TIMESTAMPS:
+            CFG_NO_TIMESTAMPS = 1;
+            break;
+        case OPT_TIME_SCALE:
+            {
+                char *ep = NULL;
+                double dval = strtod(optarg, &ep);
+                if (ep == optarg || *ep != '\0' ||
+                    dval < MIN_TIME_SCALE || dval > MAX_TIME_SCALE) {
+                    log_message(-1, "error parsing time scale: %s", optarg);
+                    return EXIT_FAILURE;
+                }
+                CFG_TIME_SCALE = dval;
+            }
+            break;
         case 'h':
             printf(USAGE_NOTICE, argv[0]);
             return EXIT_SUCCESS;
@@ -159,6 +265,10 @@ int main(int argc, char *const argv[]) {
         return EXIT_FAILURE;
     }
 
+    if (async_log && logring_start() < 0)
+        return EXIT_FAILURE;
+    if (trace_file != NULL && tracebin_open(trace_file) < 0)
+        return EXIT_FAILURE;
     if (CFG_DRY_RUN)
         log_message(0, "%sno UINPUT actions will be performed\n", CFG_DRY_RUN_PREFIX);
 
@@ -172,5 +282,9 @@ int main(int argc, char *const argv[]) {
     } else
         ret = exec_args(argc - optind, (const char *const*)&argv[optind]);
     uinput_close();
+    if (CFG_TIMINGS)
+        timing_report();
+    if (CFG_PROFILE > 0)
+        profile_report();
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
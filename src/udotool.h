@@ -9,6 +9,17 @@
 #define MAX_SLEEP_SEC         86400 ///< Maximum delay, in seconds.
 #define MIN_SLEEP_SEC         0.001 ///< Minimum delay, in seconds.
 #define DEFAULT_SETTLE_TIME   0.500 ///< Default settle time after setup, in seconds.
+#define DEFAULT_KEY_DELAY     0.050 ///< Default delay between repetitions in command `key`, in seconds.
+#define DEFAULT_SMOOTH_TIME   0.250 ///< Default duration of smooth scrolling, in seconds.
+#define DEFAULT_TYPE_RATE        50 ///< Default typing rate in command `type`, in characters per second.
+#define SMOOTH_SCROLL_RATE      120 ///< Maximum step rate of smooth scrolling, in steps per second.
+#define DEFAULT_MOTION_TIME   0.500 ///< Default duration of interpolated motion, in seconds.
+#define DEFAULT_MOTION_RATE    1000 ///< Default frame rate of interpolated motion, in frames per second.
+#define MAX_MOTION_RATE       10000 ///< Maximum frame rate of interpolated motion, in frames per second.
+
+#define MIN_TIME_SCALE        0.001 ///< Minimum time scale factor.
+#define MAX_TIME_SCALE       1000.0 ///< Maximum time scale factor.
+#define DEFAULT_PROFILE_TOP      20 ///< Default number of profiler report entries.
 
 #define UINPUT_ABS_MAXVALUE 1000000 ///< Maximum absolute axis position.
 
@@ -18,6 +29,32 @@
 extern int         CFG_VERBOSITY;
 extern int         CFG_DRY_RUN;
 extern const char *CFG_DRY_RUN_PREFIX;
+extern int         CFG_VIRTUAL_TIME;
+extern double      CFG_TIME_SCALE;
+extern int         CFG_LEAN_INIT;
+extern int         CFG_TIMINGS;
+extern int         CFG_PROFILE;
+extern int         CFG_NO_TIMESTAMPS;
 
-void log_message(int level, const char *fmt,...)
+void (log_message)(int level, const char *fmt,...)
     __attribute__ ((format (printf, 2, 3)));
+
+/**
+ * Check whether messages of specified level are printed.
+ *
+ * With tweak `NODEBUGLOG` debug messages (level 2 and above) are
+ * compiled out.
+ */
+#ifdef UDOTOOL_NODEBUGLOG_TWEAK
+#define log_enabled(level) ((level) <= 1 && (level) <= CFG_VERBOSITY)
+#else  // UDOTOOL_NODEBUGLOG_TWEAK
+#define log_enabled(level) ((level) <= CFG_VERBOSITY)
+#endif // UDOTOOL_NODEBUGLOG_TWEAK
+
+/**
+ * Print a message, if its level is enabled.
+ *
+ * Level is checked before message arguments are evaluated.
+ */
+#define log_message(level, ...) \
+    do { if (log_enabled(level)) (log_message)((level), __VA_ARGS__); } while (0)
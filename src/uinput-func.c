@@ -19,6 +19,8 @@
 
 #include "udotool.h"
 #include "uinput-func.h"
+#include "timing.h"
+#include "tracebin.h"
 
 /**
  * Default UINPUT emulation parameters.
@@ -28,7 +30,7 @@
  * - Emulated device name.
  * - Settle time in seconds.
  * - Emulated device ID.
- * - Absolute axis definition (common for all absolute axes).
+ * - Absolute axis definition (default for all absolute axes).
  */
 static char UINPUT_DEVICE[PATH_MAX] = "/dev/uinput";
 static char UINPUT_DEVNAME[UINPUT_MAX_NAME_SIZE] = "udotool";
@@ -48,17 +50,128 @@ static struct input_absinfo UINPUT_AXIS_DEF = {
     .resolution = 0, // unit/mm for main axes, unit/radian for ABS_R{X,Y,Z}
 };
 
+/**
+ * Per-axis absolute axis definitions, and flags for axes that have one.
+ */
+static struct input_absinfo UINPUT_ABS_INFO[ABS_CNT];
+static unsigned char UINPUT_ABS_CUSTOM[ABS_CNT];
+
+/**
+ * Last emitted absolute axis positions, in device units.
+ */
+static int UINPUT_ABS_POSITION[ABS_CNT];
+
 /**
  * Open callback and its data.
  */
 static udotool_open_callback_t UINPUT_OPEN_CBK = NULL;
 static void *UINPUT_OPEN_CBK_DATA = NULL;
 
+#define UINPUT_FRAME_SIZE 256 ///< Maximum number of events in frame buffer.
+
 /**
  * UINPUT device handle, or `-1` if not open yet.
  */
 static int UINPUT_FD = -1;
 
+/**
+ * Emission statistics.
+ */
+struct udotool_stats UINPUT_STATS;
+
+/**
+ * Frame buffer: events not written to the device yet.
+ */
+static struct input_event UINPUT_FRAME[UINPUT_FRAME_SIZE];
+static size_t UINPUT_FRAME_LEN = 0;
+
+static int uinput_flush(void);
+
+/**
+ * Batch state: nesting depth of batches, number of nested batches
+ * that merge frames, and flag for events not followed by a sync yet.
+ */
+static int UINPUT_BATCH_DEPTH = 0;
+static int UINPUT_BATCH_MERGE = 0;
+static int UINPUT_SYNC_PENDING = 0;
+
+/**
+ * Relative axis accumulators: fractional parts of relative movement
+ * not emitted yet, and high-resolution wheel units since the last
+ * low-resolution detent.
+ */
+static double UINPUT_REL_FRACTION[REL_CNT];
+static int UINPUT_REL_DETENT[REL_CNT];
+
+#define UINPUT_REL_EPSILON 1e-9 ///< Tolerance for rounding errors in relative movement.
+
+/**
+ * Number of IOCTLs issued.
+ */
+static unsigned UINPUT_IOCTL_COUNT = 0;
+
+/**
+ * Get absolute axis definition.
+ *
+ * @param axis  axis code.
+ * @return      axis definition.
+ */
+static const struct input_absinfo *uinput_absinfo(int axis) {
+    if (axis >= 0 && axis < ABS_CNT && UINPUT_ABS_CUSTOM[axis])
+        return &UINPUT_ABS_INFO[axis];
+    return &UINPUT_AXIS_DEF;
+}
+
+/**
+ * Parse absolute axis definitions.
+ *
+ * Definitions are separated by commas, each having the form
+ * `axis=min:max[:resolution[:fuzz[:flat]]]`.
+ *
+ * @param value  option value.
+ * @return       zero on success, or `-1` on error.
+ */
+static int uinput_set_abs(const char *value) {
+    char name[MAX_OBJECT_NAME];
+    const char *sp = value;
+    while (*sp != '\0') {
+        const char *ep = strchr(sp, '=');
+        if (ep == NULL || ep == sp || (size_t)(ep - sp) >= sizeof(name))
+            goto ON_ERROR;
+        memcpy(name, sp, ep - sp);
+        name[ep - sp] = '\0';
+        int axis = uinput_find_axis("UINPUT", name, UDOTOOL_AXIS_ABS, NULL);
+        if (axis < 0 || axis >= ABS_CNT)
+            return -1;
+        long field[5] = { 0, 0, 0, 0, 0 };
+        int nfield = 0;
+        do {
+            sp = ep + 1;
+            field[nfield++] = strtol(sp, (char **)&ep, 10);
+            if (ep == sp || field[nfield - 1] < INT_MIN || field[nfield - 1] > INT_MAX)
+                goto ON_ERROR;
+        } while (*ep == ':' && nfield < 5);
+        if ((*ep != ',' && *ep != '\0') || nfield < 2 || field[0] >= field[1] ||
+            field[2] < 0 || field[3] < 0 || field[4] < 0)
+            goto ON_ERROR;
+        struct input_absinfo *info = &UINPUT_ABS_INFO[axis];
+        info->value      = field[0];
+        info->minimum    = field[0];
+        info->maximum    = field[1];
+        info->resolution = field[2];
+        info->fuzz       = field[3];
+        info->flat       = field[4];
+        UINPUT_ABS_CUSTOM[axis] = 1;
+        UINPUT_ABS_POSITION[axis] = info->value;
+        sp = *ep == ',' ? ep + 1 : ep;
+    }
+    return 0;
+
+ON_ERROR:
+    log_message(-1, "UINPUT: error parsing absolute axis definition: %s", value);
+    return -1;
+}
+
 /**
  * Set UINPUT option.
  *
@@ -131,6 +244,8 @@ int uinput_set_option(int option, const char *value) {
             UINPUT_SETTLE_TIME = dval;
         }
         break;
+    case UINPUT_OPT_ABS:
+        return uinput_set_abs(value);
     default:
         log_message(-1, "UINPUT: unrecognized option code %d", option);
         return -1;
@@ -205,6 +320,7 @@ void uinput_set_open_callback(udotool_open_callback_t callback, void *data) {
  */
 static int uinput_ioctl_int(int fd, const char *name, unsigned long code, int arg) {
     log_message(2, "UINPUT: ioctl(%s, 0x%04X)", name, (unsigned)arg);
+    UINPUT_IOCTL_COUNT++;
     if (ioctl(fd, code, arg) == -1) {
         log_message(-1, "UINPUT: ioctl %s error: %s", name, strerror(errno));
         return -1;
@@ -223,6 +339,7 @@ static int uinput_ioctl_int(int fd, const char *name, unsigned long code, int ar
  */
 static int uinput_ioctl_ptr(int fd, const char *name, unsigned long code, void *arg) {
     log_message(2, "UINPUT: ioctl(%s, ...)", name);
+    UINPUT_IOCTL_COUNT++;
     if (ioctl(fd, code, arg) == -1) {
         log_message(-1, "UINPUT: ioctl %s error: %s", name, strerror(errno));
         return -1;
@@ -296,7 +413,7 @@ static int uinput_setup(int fd) {
     for (const struct udotool_obj_id *idptr = UINPUT_ABS_AXES; idptr->name != NULL; idptr++) {
         memset(&axis, 0, sizeof(axis));
         axis.code    = idptr->value;
-        axis.absinfo = UINPUT_AXIS_DEF;
+        axis.absinfo = *uinput_absinfo(idptr->value);
         if (uinput_ioctl_ptr(fd, "UI_ABS_SETUP", UI_ABS_SETUP, &axis) < 0)
             return -1;
     }
@@ -305,10 +422,7 @@ static int uinput_setup(int fd) {
     memset(&setup, 0, sizeof(setup));
     setup.id = UINPUT_ID;
     strncpy(setup.name, UINPUT_DEVNAME, UINPUT_MAX_NAME_SIZE);
-    if (uinput_ioctl_ptr(fd, "UI_DEV_SETUP", UI_DEV_SETUP, &setup) < 0)
-        return -1;
-
-    return uinput_ioctl_int(fd, "UI_DEV_CREATE", UI_DEV_CREATE, 0);
+    return uinput_ioctl_ptr(fd, "UI_DEV_SETUP", UI_DEV_SETUP, &setup);
 }
 
 /**
@@ -327,16 +441,28 @@ int uinput_open(void) {
         return 0;
     }
 
+    double start = timing_real_now();
     UINPUT_FD = open(UINPUT_DEVICE, O_WRONLY | O_CLOEXEC);
     if (UINPUT_FD < 0) {
         log_message(-1, "UINPUT: device %s open error: %s", UINPUT_DEVICE, strerror(errno));
         return -1;
     }
+    timing_phase(TIMING_PHASE_OPEN, start, 1);
+    start = timing_real_now();
+    unsigned ioctl_count = UINPUT_IOCTL_COUNT;
     if (uinput_setup(UINPUT_FD) < 0) {
         close(UINPUT_FD);
         UINPUT_FD = -1;
         return -1;
     }
+    timing_phase(TIMING_PHASE_SETUP, start, UINPUT_IOCTL_COUNT - ioctl_count);
+    start = timing_real_now();
+    if (uinput_ioctl_int(UINPUT_FD, "UI_DEV_CREATE", UI_DEV_CREATE, 0) < 0) {
+        close(UINPUT_FD);
+        UINPUT_FD = -1;
+        return -1;
+    }
+    timing_phase(TIMING_PHASE_CREATE, start, 1);
 
     char sysname[PATH_MAX];
     if (uinput_ioctl_ptr(UINPUT_FD, "UI_GET_SYSNAME", UI_GET_SYSNAME(sizeof(sysname)), sysname) == 0) {
@@ -348,14 +474,11 @@ int uinput_open(void) {
     if (uinput_ioctl_ptr(UINPUT_FD, "UI_GET_VERSION", UI_GET_VERSION, &version) == 0)
         log_message(1, "UINPUT: protocol version 0x%04X", version);
 
-    log_message(2, "UINPUT: waiting to settle");
-    struct timespec tval;
-    memset(&tval, 0, sizeof(tval));
-    tval.tv_sec = (time_t)UINPUT_SETTLE_TIME;
-    tval.tv_nsec = (long)(NSEC_PER_SEC * (UINPUT_SETTLE_TIME - tval.tv_sec));
-    log_message(2, "UINPUT: sleeping for %ld seconds and %ld nanoseconds", (long)tval.tv_sec, tval.tv_nsec);
-    if (nanosleep(&tval, NULL) < 0)
+    log_message(2, "UINPUT: waiting to settle for %.6f seconds", UINPUT_SETTLE_TIME);
+    start = timing_real_now();
+    if (timing_sleep(UINPUT_SETTLE_TIME) < 0)
         log_message(-1, "UINPUT: error while sleeping: %s", strerror(errno));
+    timing_phase(TIMING_PHASE_SETTLE, start, 1);
 
     return 0;
 }
@@ -367,39 +490,162 @@ void uinput_close() {
     if (UINPUT_FD < 0)
         return;
     if (!CFG_DRY_RUN) {
+        uinput_flush();
         uinput_ioctl_int(UINPUT_FD, "UI_DEV_DESTROY", UI_DEV_DESTROY, 0);
         close(UINPUT_FD);
     }
     UINPUT_FD = -1;
 }
 
+/**
+ * Write buffered events to the device.
+ *
+ * @return  zero on success, or `-1` on error.
+ */
+static int uinput_flush(void) {
+    if (UINPUT_FRAME_LEN == 0)
+        return 0;
+    size_t len = UINPUT_FRAME_LEN;
+    UINPUT_FRAME_LEN = 0;
+    if (!CFG_NO_TIMESTAMPS) {
+        // One timestamp for the whole frame
+        struct timeval ts;
+        timing_timestamp(&ts);
+        for (struct input_event *ev = UINPUT_FRAME; ev < &UINPUT_FRAME[len]; ev++) {
+            ev->input_event_sec  = ts.tv_sec;
+            ev->input_event_usec = ts.tv_usec;
+        }
+    }
+    double start = timing_real_now();
+    ssize_t ret = write(UINPUT_FD, UINPUT_FRAME, len*sizeof(UINPUT_FRAME[0]));
+    UINPUT_STATS.write_time += timing_real_now() - start;
+    if (ret == -1) {
+        UINPUT_STATS.write_errors++;
+        log_message(-1, "UINPUT write error: %s\n", strerror(errno));
+        return -1;
+    }
+    UINPUT_STATS.writes++;
+    UINPUT_STATS.bytes += ret;
+    for (const struct input_event *ev = UINPUT_FRAME; ev < &UINPUT_FRAME[len]; ev++) {
+        tracebin_event(ev->type, ev->code, ev->value);
+        switch (ev->type) {
+        case EV_SYN:
+            UINPUT_STATS.syn_events++;
+            if (ev->code == SYN_REPORT)
+                UINPUT_STATS.frames++;
+            break;
+        case EV_KEY:
+            UINPUT_STATS.key_events++;
+            break;
+        case EV_REL:
+            UINPUT_STATS.rel_events++;
+            break;
+        case EV_ABS:
+            UINPUT_STATS.abs_events++;
+            break;
+        }
+    }
+    timing_mark(TIMING_PHASE_FIRST_EVENT);
+    return 0;
+}
+
 /**
  * Emit emulated event.
  *
+ * Events are collected into the frame buffer, and written to the device
+ * all at once on synchronization (or when the buffer is full).
+ *
  * @param type   event type.
  * @param code   event code.
  * @param value  event value.
  * @return       zero on success, or `-1` on error.
  */
 static int uinput_emit(int type, int code, int value) {
+    int is_sync = type == EV_SYN && code == SYN_REPORT;
+    if (is_sync && UINPUT_BATCH_MERGE > 0)
+        return 0;
     log_message(2, "UINPUT: injecting event 0x%04X, code 0x%04X, value %d",
         (unsigned)type, (unsigned)code, value);
-    struct timeval ts;
-    gettimeofday(&ts, NULL);
-    struct input_event ev;
-    memset(&ev, 0, sizeof(ev));
-    ev.input_event_sec  = ts.tv_sec;
-    ev.input_event_usec = ts.tv_usec;
-    ev.type  = type;
-    ev.code  = code;
-    ev.value = value;
-    if (write(UINPUT_FD, &ev, sizeof(ev)) == -1) {
-        log_message(-1, "UINPUT write error: %s\n", strerror(errno));
+    if (UINPUT_FRAME_LEN == UINPUT_FRAME_SIZE && uinput_flush() < 0)
         return -1;
-    }
+    UINPUT_SYNC_PENDING = !is_sync;
+    // Timestamp is set on flush (or left zero)
+    struct input_event *ev = &UINPUT_FRAME[UINPUT_FRAME_LEN++];
+    ev->type  = type;
+    ev->code  = code;
+    ev->value = value;
+    if (is_sync && UINPUT_BATCH_DEPTH == 0)
+        return uinput_flush();
     return 0;
 }
 
+/**
+ * Start a batch.
+ *
+ * Until the batch ends, events are kept in the frame buffer and written
+ * only when the buffer is full. If `merge` is set, synchronization events
+ * are dropped as well, so all events of the batch form a single frame.
+ * Batches can be nested.
+ *
+ * @param merge  if not zero, merge all events into one frame.
+ */
+void uinput_batch_begin(int merge) {
+    UINPUT_BATCH_DEPTH++;
+    if (merge)
+        UINPUT_BATCH_MERGE++;
+}
+
+/**
+ * End a batch.
+ *
+ * When the last merging batch ends, this emits a synchronization event;
+ * when the outermost batch ends, this writes buffered events.
+ *
+ * @param merge  the same value that was passed to `uinput_batch_begin()`.
+ * @return       zero on success, or `-1` on error.
+ */
+int uinput_batch_end(int merge) {
+    int ret = 0;
+    if (merge && --UINPUT_BATCH_MERGE == 0 && UINPUT_SYNC_PENDING)
+        ret = uinput_emit(EV_SYN, SYN_REPORT, 0);
+    if (--UINPUT_BATCH_DEPTH == 0 && uinput_flush() < 0)
+        ret = -1;
+    return ret;
+}
+
+/**
+ * Suspend batches of the current track before switching to another track.
+ *
+ * Batch state is global, while tracks switch whenever they wait. So
+ * before the switch this writes buffered events (ending the merged
+ * frame, if any), and disables batching until `uinput_batch_resume()`.
+ * This way events of other tracks never join a batch.
+ *
+ * @param saved  buffer for batch state.
+ * @return       zero on success, or `-1` on error.
+ */
+int uinput_batch_suspend(struct udotool_batch *saved) {
+    saved->depth = UINPUT_BATCH_DEPTH;
+    saved->merge = UINPUT_BATCH_MERGE;
+    if (UINPUT_BATCH_DEPTH == 0)
+        return 0;
+    UINPUT_BATCH_DEPTH = 0;
+    UINPUT_BATCH_MERGE = 0;
+    if (saved->merge > 0 && UINPUT_SYNC_PENDING)
+        return uinput_emit(EV_SYN, SYN_REPORT, 0);
+    return uinput_flush();
+}
+
+/**
+ * Resume batches of the current track after other tracks have run.
+ *
+ * @param saved  batch state saved by `uinput_batch_suspend()`.
+ */
+void uinput_batch_resume(const struct udotool_batch *saved) {
+    UINPUT_BATCH_DEPTH = saved->depth;
+    UINPUT_BATCH_MERGE = saved->merge;
+}
+
 /**
  * Emit a synchronization event.
  *
@@ -439,9 +685,30 @@ int uinput_keyop(int key, int value, int sync) {
     return 0;
 }
 
+/**
+ * Accumulate relative movement and take its integer part.
+ *
+ * @param axis   axis code.
+ * @param value  change in position, in axis units.
+ * @return       whole units to emit now.
+ */
+static int uinput_rel_accumulate(int axis, double value) {
+    if (axis < 0 || axis >= REL_CNT)
+        return (int)value;
+    double total = UINPUT_REL_FRACTION[axis] + value;
+    int units = (int)(total + (total < 0 ? -UINPUT_REL_EPSILON : UINPUT_REL_EPSILON));
+    UINPUT_REL_FRACTION[axis] = total - units;
+    return units;
+}
+
 /**
  * Emit a relative axis event.
  *
+ * Fractional movement is accumulated per axis, so it's not lost. For wheel
+ * axes the value is in notches: it's emitted to the high-resolution axis,
+ * and the low-resolution axis gets a detent every time accumulated
+ * high-resolution movement in one direction reaches a whole notch.
+ *
  * @param axis   axis code.
  * @param value  change in position.
  * @param sync   if not zero, also emit a synchronization event.
@@ -457,12 +724,21 @@ int uinput_relop(int axis, double value, int sync) {
         return 0;
     for (int i = 0; UINPUT_HIRES_AXIS[i].lo_axis >= 0; i++)
         if (axis == UINPUT_HIRES_AXIS[i].lo_axis) {
-            if (uinput_emit(EV_REL, axis, (int)value) < 0)
+            int divisor = UINPUT_HIRES_AXIS[i].divisor;
+            int hires = uinput_rel_accumulate(UINPUT_HIRES_AXIS[i].hi_axis, value * divisor);
+            int *detent = &UINPUT_REL_DETENT[axis];
+            if ((*detent < 0 && hires > 0) || (*detent > 0 && hires < 0))
+                *detent = 0;
+            *detent += hires;
+            int notches = *detent / divisor;
+            *detent -= notches * divisor;
+            if ((notches != 0 && uinput_emit(EV_REL, axis, notches) < 0) ||
+                (hires != 0 && uinput_emit(EV_REL, UINPUT_HIRES_AXIS[i].hi_axis, hires) < 0))
                 return -1;
-            value *= UINPUT_HIRES_AXIS[i].divisor;
-            axis   = UINPUT_HIRES_AXIS[i].hi_axis;
+            return sync ? uinput_emit(EV_SYN, SYN_REPORT, 0) : 0;
         }
-    if (uinput_emit(EV_REL, axis, (int)value) < 0)
+    int units = uinput_rel_accumulate(axis, value);
+    if (units != 0 && uinput_emit(EV_REL, axis, units) < 0)
         return -1;
     if (sync && uinput_emit(EV_SYN, SYN_REPORT, 0) < 0)
         return -1;
@@ -470,24 +746,80 @@ int uinput_relop(int axis, double value, int sync) {
 }
 
 /**
- * Emit an absolute axis event.
+ * Get range of an absolute axis.
+ *
+ * @param axis  axis code.
+ * @param pmin  pointer to buffer for minimum value, in device units.
+ * @param pmax  pointer to buffer for maximum value, in device units.
+ */
+void uinput_abs_range(int axis, int *pmin, int *pmax) {
+    const struct input_absinfo *info = uinput_absinfo(axis);
+    *pmin = info->minimum;
+    *pmax = info->maximum;
+}
+
+/**
+ * Get last emitted position of an absolute axis.
+ *
+ * @param axis  axis code.
+ * @return      position, in device units (minimum, if nothing was emitted).
+ */
+int uinput_abs_position(int axis) {
+    if (axis < 0 || axis >= ABS_CNT)
+        return 0;
+    return UINPUT_ABS_POSITION[axis];
+}
+
+/**
+ * Convert absolute axis position from percents to device units.
+ *
+ * Integer percents are converted exactly, without floating point.
+ *
+ * @param axis     axis code.
+ * @param percent  position, in percents of axis range (`0` to `100`).
+ * @return         position, in device units.
+ */
+int uinput_abs_scale(int axis, double percent) {
+    const struct input_absinfo *info = uinput_absinfo(axis);
+    long long range = (long long)info->maximum - info->minimum;
+    if (percent == (int)percent)
+        return info->minimum + (int)((int)percent*range/100);
+    return info->minimum + (int)(percent/100.0*range);
+}
+
+/**
+ * Emit an absolute axis event, with value in device units.
  *
  * @param axis   axis code.
- * @param value  new position.
+ * @param value  new position, in device units (see `uinput_abs_range()`).
  * @param sync   if not zero, also emit a synchronization event.
  * @return       zero on success, or `-1` on error.
  */
-int uinput_absop(int axis, double value, int sync) {
+int uinput_absop_raw(int axis, int value, int sync) {
     if (uinput_open() < 0)
         return -1;
-    log_message(2, "%sUINPUT: abs 0x%02X value %lf%s",
+    log_message(2, "%sUINPUT: abs 0x%02X value %d%s",
             CFG_DRY_RUN_PREFIX,
             (unsigned)axis, value, sync ? " (sync)" : "");
+    if (axis >= 0 && axis < ABS_CNT)
+        UINPUT_ABS_POSITION[axis] = value;
     if (CFG_DRY_RUN)
         return 0;
-    if (uinput_emit(EV_ABS, axis, (int)(UINPUT_ABS_MAXVALUE * value)) < 0)
+    if (uinput_emit(EV_ABS, axis, value) < 0)
         return -1;
     if (sync && uinput_emit(EV_SYN, SYN_REPORT, 0) < 0)
         return -1;
     return 0;
 }
+
+/**
+ * Emit an absolute axis event.
+ *
+ * @param axis   axis code.
+ * @param value  new position, as a fraction of maximum (`0` to `1`).
+ * @param sync   if not zero, also emit a synchronization event.
+ * @return       zero on success, or `-1` on error.
+ */
+int uinput_absop(int axis, double value, int sync) {
+    return uinput_absop_raw(axis, uinput_abs_scale(axis, 100.0 * value), sync);
+}
@@ -13,6 +13,7 @@ enum {
     UINPUT_OPT_DEVNAME,     ///< Emulated device name.
     UINPUT_OPT_DEVID,       ///< Emulated device ID.
     UINPUT_OPT_SETTLE,      ///< Device settle time.
+    UINPUT_OPT_ABS,         ///< Absolute axis definitions.
 };
 
 /**
@@ -41,6 +42,36 @@ struct udotool_hires_axis {
     int divisor;  ///< Conversion factor.
 };
 
+/**
+ * Emission statistics.
+ */
+struct udotool_stats {
+    unsigned long syn_events;    ///< Synchronization events written.
+    unsigned long key_events;    ///< Key/button events written.
+    unsigned long rel_events;    ///< Relative axis events written.
+    unsigned long abs_events;    ///< Absolute axis events written.
+    unsigned long frames;        ///< Frames (`SYN_REPORT` events) written.
+    unsigned long writes;        ///< Successful `write()` calls.
+    unsigned long bytes;         ///< Bytes written.
+    unsigned long write_errors;  ///< Failed `write()` calls.
+    double        write_time;    ///< Time spent in `write()`, in seconds.
+    unsigned long lookups;       ///< Key/axis name lookups.
+    unsigned long cache_hits;    ///< Key/axis name lookups served from cache.
+    unsigned long budgets;       ///< Completed `budget` commands.
+    unsigned long budget_overruns; ///< `budget` commands that exceeded their budget.
+    double        budget_time;   ///< Total duration of `budget` bodies, in seconds.
+    double        budget_max;    ///< Maximum duration of a `budget` body, in seconds.
+    unsigned long allocations;   ///< Heap allocations by Jim interpreter.
+};
+
+/**
+ * Saved batch state of a track (see `uinput_batch_suspend()`).
+ */
+struct udotool_batch {
+    int depth;  ///< Nesting depth of batches.
+    int merge;  ///< Number of nested batches that merge frames.
+};
+
 /**
  * Device open callback.
  */
@@ -52,6 +83,8 @@ extern const struct udotool_obj_id UINPUT_KEYS[];
 
 extern const struct udotool_hires_axis UINPUT_HIRES_AXIS[];
 
+extern struct udotool_stats UINPUT_STATS;
+
 int uinput_set_option(int option, const char *value);
 int uinput_get_option(int option, char *buffer, size_t bufsize);
 void uinput_set_open_callback(udotool_open_callback_t callback, void *data);
@@ -62,6 +95,14 @@ int uinput_find_axis(const char *prefix, const char *name, unsigned mask, int *p
 int uinput_open(void);
 void uinput_close(void);
 int uinput_sync(void);
+void uinput_batch_begin(int merge);
+int uinput_batch_end(int merge);
+int uinput_batch_suspend(struct udotool_batch *saved);
+void uinput_batch_resume(const struct udotool_batch *saved);
 int uinput_keyop(int key, int value, int sync);
 int uinput_relop(int axis, double value, int sync);
 int uinput_absop(int axis, double value, int sync);
+int uinput_absop_raw(int axis, int value, int sync);
+void uinput_abs_range(int axis, int *pmin, int *pmax);
+int uinput_abs_scale(int axis, double percent);
+int uinput_abs_position(int axis);
@@ -4,6 +4,7 @@
  *
  * Copyright (c) 2024 Alec Kojaev
  */
+#include <ctype.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,18 +14,80 @@
 #include "udotool.h"
 #include "uinput-func.h"
 
+/**
+ * Size of name lookup cache (power of 2).
+ */
+#define UINPUT_CACHE_SIZE 64
+
+/**
+ * Name lookup cache.
+ *
+ * This is a direct-mapped cache of recently found items, indexed by
+ * case-insensitive hash of the name. Scripts tend to use the same few
+ * keys and axes over and over, while the key table is long.
+ */
+static struct uinput_cache_entry {
+    const struct udotool_obj_id *ids;   ///< List of items.
+    const struct udotool_obj_id *item;  ///< Found item.
+} UINPUT_CACHE[UINPUT_CACHE_SIZE];
+
+/**
+ * Calculate case-insensitive name hash.
+ *
+ * @param name  name.
+ * @return      hash value.
+ */
+static unsigned uinput_name_hash(const char *name) {
+    unsigned hash = 0;
+    for (const char *sp = name; *sp != '\0'; sp++)
+        hash = hash*31 + (unsigned)tolower((unsigned char)*sp);
+    return hash;
+}
+
+/**
+ * Get name lookup cache entry for a name.
+ *
+ * @param name  name.
+ * @return      cache entry.
+ */
+static struct uinput_cache_entry *uinput_cache_slot(const char *name) {
+    return &UINPUT_CACHE[uinput_name_hash(name) & (UINPUT_CACHE_SIZE - 1)];
+}
+
+/**
+ * Find an item value by name, bypassing the cache lookup.
+ *
+ * Found item is stored in the cache.
+ *
+ * @param ids    list of items.
+ * @param name   name to look for.
+ * @param cache  cache entry for the name.
+ * @return       item value, or `-1` if not found.
+ */
+static int uinput_scan_id(const struct udotool_obj_id ids[], const char *name, struct uinput_cache_entry *cache) {
+    for (const struct udotool_obj_id *idptr = ids; idptr->name != NULL; idptr++)
+        if (strcasecmp(name, idptr->name) == 0) {
+            cache->ids  = ids;
+            cache->item = idptr;
+            return idptr->value;
+        }
+    return -1;
+}
+
 /**
  * Find an item value by name.
  *
  * @param ids   list of items.
  * @param name  name to look for.
- * @return      item value.
+ * @return      item value, or `-1` if not found.
  */
 static int uinput_find_id(const struct udotool_obj_id ids[], const char *name) {
-    for (const struct udotool_obj_id *idptr = ids; idptr->name != NULL; idptr++)
-        if (strcasecmp(name, idptr->name) == 0)
-            return idptr->value;
-    return -1;
+    struct uinput_cache_entry *cache = uinput_cache_slot(name);
+    if (cache->ids == ids && strcasecmp(name, cache->item->name) == 0) {
+        UINPUT_STATS.cache_hits++;
+        return cache->item->value;
+    }
+    return uinput_scan_id(ids, name, cache);
 }
 
 /**
@@ -36,30 +99,37 @@ static int uinput_find_id(const struct udotool_obj_id ids[], const char *name) {
  * If `pflag` is not `NULL`, the buffer it points to will be set to `1`
  * if the axis is absolute, or `0` otherwise.
  *
- * @param prefix  prefix for error messages.
+ * @param prefix  prefix for error messages, or `NULL` for no messages.
  * @param name    axis name to look for.
  * @param mask    flag bit mask for types of axes to look for.
  * @param pflag   if not `NULL`, pointer to buffer to write axis type to.
  * @return        axis code, or `-1` if not found.
  */
 int uinput_find_axis(const char *prefix, const char *name, unsigned mask, int *pflag) {
-    int id;
-    if ((mask & UDOTOOL_AXIS_ABS) != 0) {
-        if ((id = uinput_find_id(UINPUT_ABS_AXES, name)) >= 0) {
-            if (pflag != NULL)
-                *pflag = 1;
-            return id;
-        }
+    int id = -1, abs_flag = 0;
+    UINPUT_STATS.lookups++;
+    // Axis tables have no names in common, so a cached item from
+    // either of them can be used before scanning any table
+    struct uinput_cache_entry *cache = uinput_cache_slot(name);
+    if (((cache->ids == UINPUT_ABS_AXES && (mask & UDOTOOL_AXIS_ABS) != 0) ||
+         (cache->ids == UINPUT_REL_AXES && (mask & UDOTOOL_AXIS_REL) != 0)) &&
+        strcasecmp(name, cache->item->name) == 0) {
+        UINPUT_STATS.cache_hits++;
+        id = cache->item->value;
+        abs_flag = cache->ids == UINPUT_ABS_AXES;
+    } else if ((mask & UDOTOOL_AXIS_ABS) != 0 && (id = uinput_scan_id(UINPUT_ABS_AXES, name, cache)) >= 0) {
+        abs_flag = 1;
+    } else if ((mask & UDOTOOL_AXIS_REL) != 0) {
+        id = uinput_scan_id(UINPUT_REL_AXES, name, cache);
     }
-    if ((mask & UDOTOOL_AXIS_REL) != 0) {
-        if ((id = uinput_find_id(UINPUT_REL_AXES, name)) >= 0) {
-            if (pflag != NULL)
-                *pflag = 0;
-            return id;
-        }
+    if (id < 0) {
+        if (prefix != NULL)
+            log_message(-1, "%s: unrecognized axis '%s'", prefix, name);
+        return -1;
     }
-    log_message(-1, "%s: unrecognized axis '%s'", prefix, name);
-    return -1;
+    if (pflag != NULL)
+        *pflag = abs_flag;
+    return id;
 }
 
 /**
@@ -68,11 +138,12 @@ int uinput_find_axis(const char *prefix, const char *name, unsigned mask, int *p
  * Key/button can be either a name from predefined list, or a numeric
  * (decimal, octal, or hexadecimal) value.
  *
- * @param prefix  prefix for error messages.
+ * @param prefix  prefix for error messages, or `NULL` for no messages.
  * @param key     key/button.
  * @return        key/button value.
  */
 int uinput_find_key(const char *prefix, const char *key) {
+    UINPUT_STATS.lookups++;
     if (key[0] >= '0' && key[0] <= '9') {
         const char *ep = key;
         unsigned long uval = strtoul(key, (char **)&ep, 0);
@@ -83,7 +154,8 @@ int uinput_find_key(const char *prefix, const char *key) {
     int id;
     if ((id = uinput_find_id(UINPUT_KEYS, key)) < 0) {
 ON_UNKN_KEY:
-        log_message(-1, "%s: unrecognized key '%s'", prefix, key);
+        if (prefix != NULL)
+            log_message(-1, "%s: unrecognized key '%s'", prefix, key);
         return -1;
     }
     return id;